@@ -0,0 +1,44 @@
+// Measure how quickly key events arrive in CONIN.  Run it under winpty (e.g.
+// console.exe InputPerfTest.exe 100000) and paste or send a large block of
+// text.  The timer starts at the first event.
+
+#include <windows.h>
+
+#include <memory>
+
+#include "TestUtil.cc"
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s RECORD_COUNT\n", argv[0]);
+        return 1;
+    }
+    const long target = atol(argv[1]);
+
+    HANDLE conin = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD mode = 0;
+    GetConsoleMode(conin, &mode);
+    SetConsoleMode(conin, mode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT));
+
+    std::vector<INPUT_RECORD> records(4096);
+    std::unique_ptr<TimeMeasurement> tm;
+    long total = 0;
+    while (total < target) {
+        DWORD actual = 0;
+        if (!ReadConsoleInputW(conin, records.data(), records.size(), &actual)) {
+            printf("ReadConsoleInputW failed\n");
+            return 1;
+        }
+        if (!tm) {
+            tm.reset(new TimeMeasurement);
+        }
+        total += actual;
+    }
+
+    const double elapsed = tm->elapsed();
+    printf("records: %ld\n", total);
+    printf("elapsed: %f\n", elapsed);
+    printf("records/sec: %f\n", total / elapsed);
+    SetConsoleMode(conin, mode);
+    return 0;
+}
@@ -122,6 +122,7 @@ def build(arch, packageDir, xp=False):
     shutil.copy(binSrc + "/winpty.dll",                 archPackageDir + "/bin")
     shutil.copy(binSrc + "/winpty-agent.exe",           archPackageDir + "/bin")
     shutil.copy(binSrc + "/winpty-debugserver.exe",     archPackageDir + "/bin")
+    shutil.copy(binSrc + "/winpty-stats.exe",           archPackageDir + "/bin")
     shutil.copy(binSrc + "/winpty.lib",                 archPackageDir + "/lib")
 
 def buildPackage():
@@ -40,18 +40,29 @@
 #include "../shared/GenRandom.h"
 #include "../shared/StringBuilder.h"
 #include "../shared/StringUtil.h"
+#include "../shared/TimeMeasurement.h"
 #include "../shared/WindowsVersion.h"
 #include "../shared/WinptyAssert.h"
 
+#include "ConsoleChangeSource.h"
 #include "ConsoleFont.h"
 #include "ConsoleInput.h"
 #include "NamedPipe.h"
 #include "Scraper.h"
 #include "Terminal.h"
 #include "Win32ConsoleBuffer.h"
+#include "WinEventChangeSource.h"
 
 namespace {
 
+// Input flow control.  A paste is read into the console in chunks, and the
+// agent stops reading CONIN while this many records are still unread.
+const DWORD kMaxPendingInputRecords = 4096;
+const size_t kConinReadChunkSize = 4096;
+
+// The most history lines one ReadHistory reply carries.
+const int kMaxHistoryReadLines = 1000;
+
 static BOOL WINAPI consoleCtrlHandler(DWORD dwCtrlType)
 {
     if (dwCtrlType == CTRL_C_EVENT) {
@@ -141,15 +152,33 @@ static int64_t int64FromHandle(HANDLE h) {
     return static_cast<int64_t>(reinterpret_cast<intptr_t>(h));
 }
 
+// The agent's total (user and kernel) CPU time, in microseconds.
+static uint64_t processCpuTimeUsec() {
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(),
+                         &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    const auto toUint64 = [](const FILETIME &ft) {
+        return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) |
+               ft.dwLowDateTime;
+    };
+    // FILETIME counts 100-nanosecond intervals.
+    return (toUint64(kernel) + toUint64(user)) / 10;
+}
+
 } // anonymous namespace
 
 Agent::Agent(LPCWSTR controlPipeName,
              uint64_t agentFlags,
              int mouseMode,
              int initialCols,
-             int initialRows) :
+             int initialRows,
+             int cpuBudget) :
     m_useConerr((agentFlags & WINPTY_FLAG_CONERR) != 0),
     m_plainMode((agentFlags & WINPTY_FLAG_PLAIN_OUTPUT) != 0),
+    m_sequentialSpawn((agentFlags & WINPTY_FLAG_SEQUENTIAL_SPAWN) != 0),
+    m_mouseAnyMotion((agentFlags & WINPTY_FLAG_MOUSE_ANY_MOTION) != 0),
     m_mouseMode(mouseMode)
 {
     trace("Agent::Agent entered");
@@ -160,7 +189,12 @@ Agent::Agent(LPCWSTR controlPipeName,
 
     const bool outputColor =
         !m_plainMode || (agentFlags & WINPTY_FLAG_COLOR_ESCAPES);
+    const bool utf16Output = (agentFlags & WINPTY_FLAG_UTF16_OUTPUT) != 0;
     const Coord initialSize(initialCols, initialRows);
+    m_scrapeScheduler.setCpuBudget(cpuBudget);
+    if (agentFlags & WINPTY_FLAG_FRAME_CREDITS) {
+        m_scrapeScheduler.enableFrameCredits();
+    }
 
     auto primaryBuffer = openPrimaryBuffer();
     if (m_useConerr) {
@@ -187,10 +221,14 @@ Agent::Agent(LPCWSTR controlPipeName,
         writePacket(setupPacket);
     }
 
+    EncodedLineCache *const lineCache =
+        hasDebugFlag("no_line_cache") ? nullptr : &m_lineCache;
     std::unique_ptr<Terminal> primaryTerminal;
     primaryTerminal.reset(new Terminal(*m_conoutPipe,
                                        m_plainMode,
-                                       outputColor));
+                                       outputColor,
+                                       utf16Output,
+                                       lineCache));
     m_primaryScraper.reset(new Scraper(m_console,
                                        *primaryBuffer,
                                        std::move(primaryTerminal),
@@ -199,13 +237,18 @@ Agent::Agent(LPCWSTR controlPipeName,
         std::unique_ptr<Terminal> errorTerminal;
         errorTerminal.reset(new Terminal(*m_conerrPipe,
                                          m_plainMode,
-                                         outputColor));
+                                         outputColor,
+                                         utf16Output,
+                                         lineCache));
         m_errorScraper.reset(new Scraper(m_console,
                                          *m_errorBuffer,
                                          std::move(errorTerminal),
                                          initialSize));
     }
 
+    // Only the CONOUT terminal's replies reach us (on CONIN).
+    m_primaryScraper->terminal().sendSyncOutputQuery();
+
     m_console.setTitle(m_currentTitle);
 
     const HANDLE conin = GetStdHandle(STD_INPUT_HANDLE);
@@ -219,6 +262,21 @@ Agent::Agent(LPCWSTR controlPipeName,
     SetConsoleCtrlHandler(NULL, FALSE);
     SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
 
+    createStatsPage();
+
+    // Scrape when the console reports a change rather than on every poll.
+    // The notifications only describe the active screen buffer, so a CONERR
+    // session, which scrapes two buffers, keeps polling.
+    if (!m_useConerr && !hasDebugFlag("no_console_events")) {
+        m_changeSource = WinEventChangeSource::create(m_console.hwnd());
+        if (m_changeSource) {
+            addWaitObject(m_changeSource->changeEvent());
+            m_scrapeScheduler.enableChangeNotifications();
+        } else {
+            trace("Console change notifications unavailable; polling");
+        }
+    }
+
     setPollInterval(25);
 }
 
@@ -229,6 +287,63 @@ Agent::~Agent()
     if (m_childProcess != NULL) {
         CloseHandle(m_childProcess);
     }
+    if (m_statsPage != nullptr) {
+        UnmapViewOfFile(m_statsPage);
+    }
+}
+
+// The stats page is a diagnostic aid, so failing to create it isn't fatal.
+void Agent::createStatsPage()
+{
+    const DWORD pid = GetCurrentProcessId();
+    const std::wstring name = statsPageName(pid);
+    HANDLE mapping = CreateFileMappingW(
+        INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        0, static_cast<DWORD>(kStatsPageSize), name.c_str());
+    if (mapping == nullptr) {
+        trace("Error creating stats page: %u",
+            static_cast<unsigned>(GetLastError()));
+        return;
+    }
+    m_statsMapping = OwnedHandle(mapping);
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        // Someone else created the section first.  Don't publish into it.
+        trace("Stats page %s already exists", utf8FromWide(name).c_str());
+        m_statsMapping.dispose();
+        return;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, kStatsPageSize);
+    if (view == nullptr) {
+        trace("Error mapping stats page: %u",
+            static_cast<unsigned>(GetLastError()));
+        m_statsMapping.dispose();
+        return;
+    }
+    m_statsPage = initStatsPage(view, pid);
+}
+
+void Agent::publishStats()
+{
+    if (m_statsPage == nullptr) {
+        return;
+    }
+    m_stats.freezeCount = m_console.freezeCount();
+    m_stats.freezeUsec = m_console.freezeUsec();
+    m_stats.inputThrottled = m_inputThrottled;
+    if (m_inputThrottled) {
+        const DWORD now = GetTickCount();
+        m_stats.inputThrottledMsec += now - m_inputThrottleStart;
+        m_inputThrottleStart = now;
+    }
+    m_stats.lineCacheHitCount = m_lineCache.hitCount();
+    m_stats.lineCacheMissCount = m_lineCache.missCount();
+    m_stats.conoutBytes = m_conoutPipe->bytesWritten();
+    m_stats.conoutQueueBytes = m_conoutPipe->bytesToSend();
+    if (m_conerrPipe != nullptr) {
+        m_stats.conerrBytes = m_conerrPipe->bytesWritten();
+        m_stats.conerrQueueBytes = m_conerrPipe->bytesToSend();
+    }
+    writeStatsPage(*m_statsPage, m_stats);
 }
 
 // Write a "Device Status Report" command to the terminal.  The terminal will
@@ -237,11 +352,18 @@ Agent::~Agent()
 // bytes before it are complete keypresses.
 void Agent::sendDsr()
 {
-    if (!m_plainMode && !m_conoutPipe->isClosed()) {
-        m_conoutPipe->write("\x1B[6n");
+    if (!m_conoutPipe->isClosed()) {
+        m_primaryScraper->terminal().sendDsr();
     }
 }
 
+void Agent::setSyncOutputSupported(bool supported)
+{
+    trace("Terminal synchronized output: %s",
+          supported ? "supported" : "unsupported");
+    m_primaryScraper->terminal().setSyncOutputSupported(supported);
+}
+
 NamedPipe &Agent::connectToControlPipe(LPCWSTR pipeName)
 {
     NamedPipe &pipe = createNamedPipe();
@@ -336,6 +458,21 @@ void Agent::handlePacket(ReadBuffer &packet)
     case AgentMsg::GetConsoleProcessList:
         handleGetConsoleProcessListPacket(packet);
         break;
+    case AgentMsg::SetVisibility:
+        handleSetVisibilityPacket(packet);
+        break;
+    case AgentMsg::SetViewport:
+        handleSetViewportPacket(packet);
+        break;
+    case AgentMsg::SetCpuBudget:
+        handleSetCpuBudgetPacket(packet);
+        break;
+    case AgentMsg::GrantFrameCredits:
+        handleGrantFrameCreditsPacket(packet);
+        break;
+    case AgentMsg::ReadHistory:
+        handleReadHistoryPacket(packet);
+        break;
     default:
         trace("Unrecognized message, id:%d", type);
     }
@@ -350,8 +487,29 @@ void Agent::writePacket(WriteBuffer &packet)
 
 void Agent::handleStartProcessPacket(ReadBuffer &packet)
 {
-    ASSERT(m_childProcess == nullptr);
-    ASSERT(!m_closingOutputPipes);
+    if (m_closingOutputPipes) {
+        // An earlier child was spawned with WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN,
+        // and it has exited, so the data pipes are closing.
+        auto reply = newPacket();
+        reply.putInt32(static_cast<int32_t>(
+            StartProcessResult::AgentShutDown));
+        writePacket(reply);
+        return;
+    }
+    if (m_childProcess != nullptr) {
+        ASSERT(m_sequentialSpawn);
+        if (WaitForSingleObject(m_childProcess, 0) != WAIT_OBJECT_0) {
+            auto reply = newPacket();
+            reply.putInt32(static_cast<int32_t>(
+                StartProcessResult::ChildStillRunning));
+            writePacket(reply);
+            return;
+        }
+        removeWaitObject(m_childProcess);
+        CloseHandle(m_childProcess);
+        m_childProcess = nullptr;
+        resetForNextProcess();
+    }
 
     const uint64_t spawnFlags = packet.getInt64();
     const bool wantProcessHandle = packet.getInt32() != 0;
@@ -409,6 +567,9 @@ void Agent::handleStartProcessPacket(ReadBuffer &packet)
         CloseHandle(pi.hThread);
         m_childProcess = pi.hProcess;
         m_autoShutdown = (spawnFlags & WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN) != 0;
+        if (m_autoShutdown) {
+            addWaitObject(m_childProcess);
+        }
         m_exitAfterShutdown = (spawnFlags & WINPTY_SPAWN_FLAG_EXIT_AFTER_SHUTDOWN) != 0;
         reply.putInt32(static_cast<int32_t>(StartProcessResult::ProcessCreated));
         reply.putInt64(replyProcess);
@@ -457,23 +618,157 @@ void Agent::handleGetConsoleProcessListPacket(ReadBuffer &packet)
     writePacket(reply);
 }
 
+void Agent::handleSetVisibilityPacket(ReadBuffer &packet)
+{
+    const int visibility = packet.getInt32();
+    packet.assertEof();
+    switch (visibility) {
+        case WINPTY_VISIBILITY_HIDDEN:
+            m_scrapeScheduler.setVisibility(
+                ScrapeScheduler::Visibility::Hidden);
+            break;
+        case WINPTY_VISIBILITY_MINIMIZED:
+            m_scrapeScheduler.setVisibility(
+                ScrapeScheduler::Visibility::Minimized);
+            break;
+        default:
+            m_scrapeScheduler.setVisibility(
+                ScrapeScheduler::Visibility::Visible);
+            break;
+    }
+    trace("Terminal visibility changed to %d", visibility);
+    auto reply = newPacket();
+    writePacket(reply);
+}
+
+void Agent::handleSetViewportPacket(ReadBuffer &packet)
+{
+    const int firstRow = packet.getInt32();
+    const int rowCount = packet.getInt32();
+    packet.assertEof();
+    m_primaryScraper->setViewport(firstRow, rowCount);
+    if (m_errorScraper) {
+        m_errorScraper->setViewport(firstRow, rowCount);
+    }
+    auto reply = newPacket();
+    writePacket(reply);
+}
+
+void Agent::handleSetCpuBudgetPacket(ReadBuffer &packet)
+{
+    const int percent = packet.getInt32();
+    packet.assertEof();
+    m_scrapeScheduler.setCpuBudget(percent);
+    auto reply = newPacket();
+    writePacket(reply);
+}
+
+void Agent::handleGrantFrameCreditsPacket(ReadBuffer &packet)
+{
+    const int credits = packet.getInt32();
+    packet.assertEof();
+    m_scrapeScheduler.grantFrameCredits(credits);
+    auto reply = newPacket();
+    writePacket(reply);
+}
+
+// The reply describes the range actually returned, which is clipped to the
+// lines the history store still has and to kMaxHistoryReadLines.
+void Agent::handleReadHistoryPacket(ReadBuffer &packet)
+{
+    const int stream = packet.getInt32();
+    const int64_t first = packet.getInt64();
+    const int count = packet.getInt32();
+    packet.assertEof();
+
+    const Scraper *scraper = nullptr;
+    if (stream == WINPTY_STREAM_CONOUT) {
+        scraper = m_primaryScraper.get();
+    } else if (stream == WINPTY_STREAM_CONERR) {
+        scraper = m_errorScraper.get();
+    }
+
+    auto reply = newPacket();
+    if (scraper == nullptr) {
+        reply.putInt64(0);
+        reply.putInt64(0);
+        reply.putInt64(0);
+        reply.putInt32(0);
+        writePacket(reply);
+        return;
+    }
+    const HistoryStore &history = scraper->history();
+    const int64_t replyFirst =
+        std::max(history.firstLine(), std::min(first, history.endLine()));
+    const int replyCount = static_cast<int>(std::min<int64_t>(
+        std::min(std::max(count, 0), kMaxHistoryReadLines),
+        history.endLine() - replyFirst));
+    reply.putInt64(history.firstLine());
+    reply.putInt64(history.endLine());
+    reply.putInt64(replyFirst);
+    reply.putInt32(replyCount);
+    std::wstring text;
+    std::vector<HistoryAttrRun> runs;
+    for (int i = 0; i < replyCount; ++i) {
+        history.readLine(replyFirst + i, text, runs);
+        reply.putWString(text);
+        reply.putInt32(static_cast<int32_t>(runs.size()));
+        for (const auto &run : runs) {
+            reply.putRawValue<uint16_t>(static_cast<uint16_t>(run.length));
+            reply.putRawValue<uint16_t>(run.attributes);
+        }
+    }
+    writePacket(reply);
+}
+
+// Move input from the CONIN pipe into the console, unless the console app
+// has fallen behind.  With too many input records pending, the agent stops
+// reading CONIN.  The NamedPipe stops issuing reads once its queue fills, and
+// the client's writes then block.  The poll timer retries once the app has
+// drained its input.
 void Agent::pollConinPipe()
 {
-    const std::string newData = m_coninPipe->readAllToString();
-    if (hasDebugFlag("input_separated_bytes")) {
-        // This debug flag is intended to help with testing incomplete escape
-        // sequences and multibyte UTF-8 encodings.  (I wonder if the normal
-        // code path ought to advance a state machine one byte at a time.)
-        for (size_t i = 0; i < newData.size(); ++i) {
-            m_consoleInput->writeInput(newData.substr(i, 1));
+    while (m_coninPipe->bytesAvailable() > 0) {
+        if (m_consoleInput->pendingRecordCount() >= kMaxPendingInputRecords) {
+            if (!m_inputThrottled) {
+                m_inputThrottled = true;
+                m_inputThrottleStart = GetTickCount();
+                m_stats.inputThrottleCount++;
+            }
+            return;
+        }
+        if (m_inputThrottled) {
+            m_inputThrottled = false;
+            m_stats.inputThrottledMsec += GetTickCount() - m_inputThrottleStart;
+        }
+        const std::string newData =
+            m_coninPipe->readToString(kConinReadChunkSize);
+        m_stats.coninBytes += newData.size();
+        if (!newData.empty() && !m_inputLatencyPending) {
+            // Time the first unanswered input until output follows it.
+            m_inputLatencyPending = true;
+            m_inputLatencyStart = TimeMeasurement();
+        }
+        if (hasDebugFlag("input_separated_bytes")) {
+            // This debug flag is intended to help with testing incomplete
+            // escape sequences and multibyte UTF-8 encodings.  (I wonder if
+            // the normal code path ought to advance a state machine one byte
+            // at a time.)
+            for (size_t i = 0; i < newData.size(); ++i) {
+                m_consoleInput->writeInput(newData.substr(i, 1));
+            }
+        } else {
+            m_consoleInput->writeInput(newData);
         }
-    } else {
-        m_consoleInput->writeInput(newData);
     }
 }
 
 void Agent::onPollTimeout()
 {
+    if (m_inputThrottled) {
+        pollConinPipe();
+    }
+
     m_consoleInput->updateInputFlags();
     const bool enableMouseMode = m_consoleInput->shouldActivateTerminalMouse();
 
@@ -481,32 +776,120 @@ void Agent::onPollTimeout()
     // escape sequence (e.g. pressing ESC).
     m_consoleInput->flushIncompleteEscapeCode();
 
-    const bool shouldScrapeContent = !m_closingOutputPipes;
+    takeConsoleChanges();
+    scrapeIfDue();
 
-    // Check if the child process has exited.
-    if (m_autoShutdown &&
-            m_childProcess != nullptr &&
-            WaitForSingleObject(m_childProcess, 0) == WAIT_OBJECT_0) {
-        CloseHandle(m_childProcess);
-        m_childProcess = nullptr;
+    // We must ensure that we disable mouse mode before closing the CONOUT
+    // pipe, so update the mouse mode here.  Every movement over the terminal
+    // is only reported if the console app wants it.
+    Terminal::MouseTracking tracking = Terminal::MouseTracking::Off;
+    if (enableMouseMode && !m_closingOutputPipes) {
+        tracking = m_mouseAnyMotion || m_consoleInput->appConsumesMouseMotion()
+            ? Terminal::MouseTracking::AnyMotion
+            : Terminal::MouseTracking::ButtonMotion;
+    }
+    m_primaryScraper->terminal().setMouseTracking(tracking);
+
+    autoClosePipesForShutdown();
+    publishStats();
+}
+
+void Agent::onWaitObjectSignaled(HANDLE handle)
+{
+    if (handle == m_childProcess) {
+        onAutoShutdownChildExited();
+    } else if (m_changeSource && handle == m_changeSource->changeEvent()) {
+        takeConsoleChanges();
+        scrapeIfDue();
+    }
+}
 
-        // Close the data socket to signal to the client that the child
-        // process has exited.  If there's any data left to send, send it
-        // before closing the socket.
-        m_closingOutputPipes = true;
+void Agent::takeConsoleChanges()
+{
+    if (!m_changeSource) {
+        return;
     }
+    ConsoleChanges changes;
+    m_changeSource->takeChanges(changes);
+    if (changes.any) {
+        m_scrapeScheduler.notifyChange();
+        m_primaryScraper->addChangeHint(changes);
+    }
+}
 
-    // Scrape for output *after* the above exit-check to ensure that we collect
-    // the child process's final output.
-    if (shouldScrapeContent) {
+void Agent::scrapeIfDue()
+{
+    // While the terminal is hidden, the scheduler only lets us scrape
+    // occasionally, and with frame credits, only while the client has granted
+    // some.  We still scrape early if lines are about to scroll out of the
+    // console buffer.  That check reads the console, so the scheduler limits
+    // how often it runs, and its CPU time counts against the budget.  After
+    // an auto-shutdown child exits, the final scrape has already happened.
+    if (m_closingOutputPipes) {
+        return;
+    }
+    const uint32_t now = GetTickCount();
+    bool scrapeDue = m_scrapeScheduler.isScrapeDue(now);
+    if (!scrapeDue && m_scrapeScheduler.isRiskCheckDue(now)) {
+        const uint64_t cpuStart = processCpuTimeUsec();
+        scrapeDue = isScrollbackAtRisk();
+        m_scrapeScheduler.riskCheckCompleted(
+            GetTickCount(),
+            static_cast<uint32_t>(processCpuTimeUsec() - cpuStart));
+    }
+    if (scrapeDue) {
+        TimeMeasurement latency;
+        const uint64_t cpuStart = processCpuTimeUsec();
+        const uint64_t bytesBefore = outputBytesWritten();
         syncConsoleTitle();
         scrapeBuffers();
+        if (outputBytesWritten() != bytesBefore) {
+            // A scrape that found nothing new doesn't cost a frame credit.
+            m_scrapeScheduler.frameSent();
+            m_consoleInput->outputChanged();
+            if (m_inputLatencyPending) {
+                m_inputLatencyPending = false;
+                const uint64_t usec = static_cast<uint64_t>(
+                    m_inputLatencyStart.elapsed() * 1000000.0);
+                addLatencySample(m_stats.inputLatencyHistogram, usec);
+                m_stats.inputLatencySumUsec += usec;
+            }
+        }
+        const uint32_t cpuUsec =
+            static_cast<uint32_t>(processCpuTimeUsec() - cpuStart);
+        const uint64_t latencyUsec =
+            static_cast<uint64_t>(latency.elapsed() * 1000000.0);
+        m_stats.scrapeCount++;
+        m_stats.scrapeCpuUsec += cpuUsec;
+        addLatencySample(m_stats.scrapeLatencyHistogram, latencyUsec);
+        m_stats.scrapeLatencySumUsec += latencyUsec;
+        if (m_scrapeScheduler.scrapeCompleted(GetTickCount(), cpuUsec)) {
+            // Over the CPU budget, the next scrape waits for the budget to
+            // refill.
+            m_stats.cpuBudgetHitCount++;
+        }
     }
+}
+
+// With WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN, the child's exit wakes the event loop
+// right away.  Collect the child's final output, then close the data pipes to
+// signal to the client that the child has exited.  If there's any data left
+// to send, the pipes are closed once it has been written.
+void Agent::onAutoShutdownChildExited()
+{
+    ASSERT(m_autoShutdown && !m_closingOutputPipes);
+    removeWaitObject(m_childProcess);
+    CloseHandle(m_childProcess);
+    m_childProcess = nullptr;
+
+    syncConsoleTitle();
+    scrapeBuffers();
+    m_closingOutputPipes = true;
 
     // We must ensure that we disable mouse mode before closing the CONOUT
-    // pipe, so update the mouse mode here.
-    m_primaryScraper->terminal().enableMouseMode(
-        enableMouseMode && !m_closingOutputPipes);
+    // pipe.
+    m_primaryScraper->terminal().setMouseTracking(
+        Terminal::MouseTracking::Off);
 
     autoClosePipesForShutdown();
 }
@@ -587,6 +970,14 @@ void Agent::resizeWindow(int cols, int rows)
     WriteConsoleInputW(GetStdHandle(STD_INPUT_HANDLE), &sizeEvent, 1, &actual);
 }
 
+bool Agent::isScrollbackAtRisk()
+{
+    if (m_primaryScraper->isScrollbackAtRisk(*openPrimaryBuffer())) {
+        return true;
+    }
+    return m_errorScraper && m_errorScraper->isScrollbackAtRisk(*m_errorBuffer);
+}
+
 void Agent::scrapeBuffers()
 {
     Win32Console::FreezeGuard guard(m_console, m_console.frozen());
@@ -598,13 +989,39 @@ void Agent::scrapeBuffers()
     }
 }
 
+uint64_t Agent::outputBytesWritten()
+{
+    uint64_t ret = m_conoutPipe->bytesWritten();
+    if (m_conerrPipe != nullptr) {
+        ret += m_conerrPipe->bytesWritten();
+    }
+    return ret;
+}
+
+// Return the console to a clean state for another child process, after
+// sending the previous child's remaining output.
+void Agent::resetForNextProcess()
+{
+    trace("Resetting the console for the next child process");
+    syncConsoleTitle();
+    scrapeBuffers();
+    {
+        Win32Console::FreezeGuard guard(m_console, true);
+        m_primaryScraper->resetForNextProcess(*openPrimaryBuffer());
+        if (m_errorScraper) {
+            m_errorScraper->resetForNextProcess(*m_errorBuffer);
+        }
+    }
+    m_consoleInput->reset();
+    m_console.setTitle(L" ");
+    m_scrapeScheduler.requestScrape();
+}
+
 void Agent::syncConsoleTitle()
 {
     std::wstring newTitle = m_console.title();
     if (newTitle != m_currentTitle) {
-        std::string command = std::string("\x1b]0;") +
-                utf8FromWide(newTitle) + "\x07";
-        m_conoutPipe->write(command.c_str());
+        m_primaryScraper->terminal().sendTitle(newTitle);
         m_currentTitle = newTitle;
     }
 }
@@ -28,9 +28,16 @@
 #include <string>
 
 #include "DsrSender.h"
+#include "EncodedLineCache.h"
 #include "EventLoop.h"
+#include "ScrapeScheduler.h"
 #include "Win32Console.h"
 
+#include "../shared/OwnedHandle.h"
+#include "../shared/StatsPage.h"
+#include "../shared/TimeMeasurement.h"
+
+class ConsoleChangeSource;
 class ConsoleInput;
 class NamedPipe;
 class ReadBuffer;
@@ -45,9 +52,11 @@ public:
           uint64_t agentFlags,
           int mouseMode,
           int initialCols,
-          int initialRows);
+          int initialRows,
+          int cpuBudget);
     virtual ~Agent();
     void sendDsr() override;
+    void setSyncOutputSupported(bool supported) override;
 
 private:
     NamedPipe &connectToControlPipe(LPCWSTR pipeName);
@@ -60,24 +69,41 @@ private:
     void handleStartProcessPacket(ReadBuffer &packet);
     void handleSetSizePacket(ReadBuffer &packet);
     void handleGetConsoleProcessListPacket(ReadBuffer &packet);
+    void handleSetVisibilityPacket(ReadBuffer &packet);
+    void handleSetViewportPacket(ReadBuffer &packet);
+    void handleSetCpuBudgetPacket(ReadBuffer &packet);
+    void handleGrantFrameCreditsPacket(ReadBuffer &packet);
+    void handleReadHistoryPacket(ReadBuffer &packet);
     void pollConinPipe();
 
 protected:
     virtual void onPollTimeout() override;
     virtual void onPipeIo(NamedPipe &namedPipe) override;
+    virtual void onWaitObjectSignaled(HANDLE handle) override;
 
 private:
+    void onAutoShutdownChildExited();
     void autoClosePipesForShutdown();
     std::unique_ptr<Win32ConsoleBuffer> openPrimaryBuffer();
     void resizeWindow(int cols, int rows);
+    bool isScrollbackAtRisk();
+    void takeConsoleChanges();
+    void scrapeIfDue();
     void scrapeBuffers();
+    uint64_t outputBytesWritten();
+    void resetForNextProcess();
     void syncConsoleTitle();
+    void createStatsPage();
+    void publishStats();
 
 private:
     const bool m_useConerr;
     const bool m_plainMode;
+    const bool m_sequentialSpawn;
+    const bool m_mouseAnyMotion;
     const int m_mouseMode;
     Win32Console m_console;
+    EncodedLineCache m_lineCache;
     std::unique_ptr<Scraper> m_primaryScraper;
     std::unique_ptr<Scraper> m_errorScraper;
     std::unique_ptr<Win32ConsoleBuffer> m_errorBuffer;
@@ -89,7 +115,16 @@ private:
     bool m_exitAfterShutdown = false;
     bool m_closingOutputPipes = false;
     std::unique_ptr<ConsoleInput> m_consoleInput;
+    bool m_inputThrottled = false;
+    DWORD m_inputThrottleStart = 0;
+    bool m_inputLatencyPending = false;
+    TimeMeasurement m_inputLatencyStart;
     HANDLE m_childProcess = nullptr;
+    ScrapeScheduler m_scrapeScheduler;
+    std::unique_ptr<ConsoleChangeSource> m_changeSource;
+    AgentStats m_stats;
+    OwnedHandle m_statsMapping;
+    StatsPage *m_statsPage = nullptr;
 
     // If the title is initialized to the empty string, then cmd.exe will
     // sometimes print this error:
@@ -0,0 +1,128 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "ConsoleChangeSource.h"
+
+#include <algorithm>
+
+namespace {
+
+inline int lowShort(LONG value) {
+    return static_cast<short>(value & 0xFFFF);
+}
+
+inline int highShort(LONG value) {
+    return static_cast<short>((value >> 16) & 0xFFFF);
+}
+
+} // anonymous namespace
+
+void ConsoleChanges::addRows(int first, int stop)
+{
+    if (!any || (!full && firstRow == stopRow)) {
+        firstRow = first;
+        stopRow = stop;
+    } else if (first < stop) {
+        firstRow = std::min(firstRow, first);
+        stopRow = std::max(stopRow, stop);
+    }
+    any = true;
+}
+
+void ConsoleChanges::addFull()
+{
+    any = true;
+    full = true;
+}
+
+void ConsoleChanges::merge(const ConsoleChanges &other)
+{
+    if (other.full) {
+        addFull();
+    } else if (other.any) {
+        addRows(other.firstRow, other.stopRow);
+    }
+}
+
+bool ConsoleChanges::limitRows(int windowTop, int &firstLine,
+                               int &stopLine) const
+{
+    if (!any || full) {
+        return false;
+    }
+    firstLine = std::max(firstLine, firstRow - windowTop);
+    stopLine = std::min(stopLine, stopRow - windowTop);
+    if (firstLine > stopLine) {
+        firstLine = stopLine;
+    }
+    return true;
+}
+
+bool ConsoleChanges::coversRows(int windowTop, int windowHeight,
+                                int firstLine, int stopLine) const
+{
+    if (!any) {
+        return true;
+    }
+    int changedFirst = 0;
+    int changedStop = windowHeight;
+    if (!full) {
+        changedFirst = std::max(changedFirst, firstRow - windowTop);
+        changedStop = std::min(changedStop, stopRow - windowTop);
+    }
+    return changedFirst >= changedStop ||
+        (firstLine <= changedFirst && changedStop <= stopLine);
+}
+
+void ConsoleEventRecorder::record(DWORD event, LONG idObject, LONG idChild)
+{
+    switch (event) {
+        case EVENT_CONSOLE_UPDATE_REGION:
+            // idObject is the top-left corner, and idChild is the
+            // bottom-right corner, inclusive.
+            m_pending.addRows(highShort(idObject), highShort(idChild) + 1);
+            break;
+        case EVENT_CONSOLE_UPDATE_SIMPLE:
+            // idObject is the updated cell.
+            m_pending.addRows(highShort(idObject), highShort(idObject) + 1);
+            break;
+        case EVENT_CONSOLE_CARET:
+            // idChild is the caret position.  Conhost raises the event as the
+            // caret blinks, too, so only count it when the caret moves.
+            if (!m_haveCaret || idChild != m_lastCaret) {
+                m_haveCaret = true;
+                m_lastCaret = idChild;
+                m_pending.addRows(0, 0);
+            }
+            break;
+        case EVENT_CONSOLE_UPDATE_SCROLL:
+        case EVENT_CONSOLE_LAYOUT:
+            m_pending.addFull();
+            break;
+        default:
+            break;
+    }
+}
+
+void ConsoleEventRecorder::take(ConsoleChanges &out)
+{
+    out.merge(m_pending);
+    m_pending.clear();
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_CONSOLE_CHANGE_SOURCE_H
+#define AGENT_CONSOLE_CHANGE_SOURCE_H
+
+#include <windows.h>
+
+// Notifications that the console changed, so the agent can scrape when there
+// is something to scrape instead of on every poll.  The Windows
+// implementation (WinEventChangeSource) listens for the console's
+// accessibility events.  The tests use a scripted source instead.
+
+// The changes reported since they were last taken, merged together.  Rows are
+// screen buffer rows.
+struct ConsoleChanges {
+    bool any = false;
+    // The window scrolled or the layout changed, so any row may differ.
+    bool full = false;
+    // Otherwise, rows [firstRow, stopRow) changed.  The range is empty when
+    // only the caret moved.
+    int firstRow = 0;
+    int stopRow = 0;
+
+    void addRows(int first, int stop);
+    void addFull();
+    void merge(const ConsoleChanges &other);
+    void clear() { *this = ConsoleChanges(); }
+
+    // Narrows [firstLine, stopLine), relative to a window whose top is
+    // windowTop, to the changed rows.  Returns false if every row must be
+    // read anyway.
+    bool limitRows(int windowTop, int &firstLine, int &stopLine) const;
+    // Whether reading [firstLine, stopLine) picks up every change within a
+    // window of windowHeight rows whose top is windowTop.
+    bool coversRows(int windowTop, int windowHeight,
+                    int firstLine, int stopLine) const;
+};
+
+// Turns the console's WinEvents (EVENT_CONSOLE_xxx) into ConsoleChanges.
+class ConsoleEventRecorder {
+public:
+    void record(DWORD event, LONG idObject, LONG idChild);
+    void take(ConsoleChanges &out);
+
+private:
+    ConsoleChanges m_pending;
+    bool m_haveCaret = false;
+    LONG m_lastCaret = 0;
+};
+
+class ConsoleChangeSource {
+public:
+    virtual ~ConsoleChangeSource() {}
+    // A manual-reset event that's signaled when changes are pending.  The
+    // EventLoop polls its wait objects after WaitForMultipleObjects returns,
+    // so an auto-reset event would already be reset by then.
+    virtual HANDLE changeEvent() = 0;
+    // Merges the pending changes into out, clears them, and resets the
+    // change event.
+    virtual void takeChanges(ConsoleChanges &out) = 0;
+};
+
+#endif // AGENT_CONSOLE_CHANGE_SOURCE_H
@@ -0,0 +1,255 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for console change notifications and the scrape decisions
+// they drive.  It only needs a minimal <windows.h>, e.g.:
+//     g++ -std=c++11 -I../tests/common ConsoleChangeSourceTest.cc
+//         ConsoleChangeSource.cc ScrapeScheduler.cc
+
+#include "ConsoleChangeSource.h"
+#include "ScrapeScheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "../tests/common/TestCheck.h"
+
+namespace {
+
+inline LONG makeLong(int low, int high) {
+    return static_cast<LONG>((static_cast<uint32_t>(high & 0xFFFF) << 16) |
+                             static_cast<uint32_t>(low & 0xFFFF));
+}
+
+struct RawEvent {
+    DWORD event;
+    LONG idObject;
+    LONG idChild;
+};
+
+// Replays a script of WinEvents, as conhost would deliver them.
+class ScriptedChangeSource : public ConsoleChangeSource {
+public:
+    void deliver(const std::vector<RawEvent> &events) {
+        for (const auto &e : events) {
+            m_recorder.record(e.event, e.idObject, e.idChild);
+        }
+    }
+    HANDLE changeEvent() override { return nullptr; }
+    void takeChanges(ConsoleChanges &out) override { m_recorder.take(out); }
+
+private:
+    ConsoleEventRecorder m_recorder;
+};
+
+RawEvent region(int left, int top, int right, int bottom) {
+    return RawEvent { EVENT_CONSOLE_UPDATE_REGION,
+                      makeLong(left, top), makeLong(right, bottom) };
+}
+
+RawEvent simple(int x, int y) {
+    return RawEvent { EVENT_CONSOLE_UPDATE_SIMPLE, makeLong(x, y), 0 };
+}
+
+RawEvent caret(int x, int y) {
+    return RawEvent { EVENT_CONSOLE_CARET, 1, makeLong(x, y) };
+}
+
+ConsoleChanges take(ConsoleChangeSource &source) {
+    ConsoleChanges ret;
+    source.takeChanges(ret);
+    return ret;
+}
+
+void testRecorder() {
+    ScriptedChangeSource source;
+    CHECK(!take(source).any);
+
+    // Regions and single cells merge into one row range.
+    source.deliver({ region(0, 10, 79, 12), simple(5, 3) });
+    ConsoleChanges c = take(source);
+    CHECK(c.any && !c.full && c.firstRow == 3 && c.stopRow == 13);
+    CHECK(!take(source).any);
+
+    // Rows near the bottom of the 3000-line buffer don't overflow.
+    source.deliver({ simple(0, 2999) });
+    c = take(source);
+    CHECK(c.any && c.firstRow == 2999 && c.stopRow == 3000);
+
+    // A blinking caret isn't a change, but a moving one is, without dirtying
+    // any row.
+    source.deliver({ caret(4, 7) });
+    c = take(source);
+    CHECK(c.any && !c.full && c.firstRow == c.stopRow);
+    source.deliver({ caret(4, 7), caret(4, 7) });
+    CHECK(!take(source).any);
+    source.deliver({ caret(5, 7) });
+    CHECK(take(source).any);
+
+    // A caret move doesn't widen a row range.
+    source.deliver({ caret(0, 0), simple(1, 20) });
+    c = take(source);
+    CHECK(c.firstRow == 20 && c.stopRow == 21);
+    source.deliver({ simple(1, 20), caret(9, 9) });
+    c = take(source);
+    CHECK(c.firstRow == 20 && c.stopRow == 21);
+
+    // Scrolling and layout changes invalidate everything.
+    source.deliver({ simple(1, 1),
+                     RawEvent { EVENT_CONSOLE_UPDATE_SCROLL, 0, -1 } });
+    CHECK(take(source).full);
+    source.deliver({ RawEvent { EVENT_CONSOLE_LAYOUT, 0, 0 } });
+    CHECK(take(source).full);
+
+    // Unrelated events are ignored.
+    source.deliver({ RawEvent { 0x4006, 0, 0 } });
+    CHECK(!take(source).any);
+}
+
+void testRowLimits() {
+    // A 25-row window at buffer row 100.
+    const int top = 100;
+    const int h = 25;
+
+    ConsoleChanges none;
+    int first = 0;
+    int stop = h;
+    CHECK(!none.limitRows(top, first, stop) && first == 0 && stop == h);
+    CHECK(none.coversRows(top, h, 0, 0));
+
+    ConsoleChanges full;
+    full.addFull();
+    CHECK(!full.limitRows(top, first, stop));
+    CHECK(full.coversRows(top, h, 0, h));
+    CHECK(!full.coversRows(top, h, 0, h - 1));
+
+    ConsoleChanges rows;
+    rows.addRows(105, 108);
+    CHECK(rows.limitRows(top, first, stop) && first == 5 && stop == 8);
+    CHECK(rows.coversRows(top, h, 5, 8));
+    CHECK(rows.coversRows(top, h, 0, h));
+    CHECK(!rows.coversRows(top, h, 6, h));
+
+    // Changes outside the window don't need reading.
+    ConsoleChanges above;
+    above.addRows(10, 20);
+    first = 0;
+    stop = h;
+    CHECK(above.limitRows(top, first, stop) && first == stop);
+    CHECK(above.coversRows(top, h, 3, 3));
+
+    // A viewport-narrowed range only partly covers the changes.
+    first = 0;
+    stop = 10;
+    ConsoleChanges wide;
+    wide.addRows(95, 130);
+    CHECK(wide.limitRows(top, first, stop) && first == 0 && stop == 10);
+    CHECK(!wide.coversRows(top, h, first, stop));
+}
+
+void testScheduler() {
+    ScriptedChangeSource source;
+    ScrapeScheduler sched;
+    sched.enableChangeNotifications();
+
+    // The first scrape is always due.
+    CHECK(sched.isScrapeDue(1000));
+    sched.scrapeCompleted(1000, 0);
+
+    // A quiet console isn't scraped on every poll...
+    CHECK(!sched.isScrapeDue(1025));
+    CHECK(!sched.isScrapeDue(1499));
+    // ...but is still scraped occasionally.
+    CHECK(sched.isScrapeDue(1500));
+    sched.scrapeCompleted(1500, 0);
+
+    // A change makes the next scrape due once the poll interval has passed
+    // since the last one.
+    source.deliver({ simple(0, 0) });
+    if (take(source).any) {
+        sched.notifyChange();
+    }
+    CHECK(sched.changePending() && !sched.isScrapeDue(1501));
+    CHECK(!sched.isChangeScrapeAllowed(1524));
+    CHECK(sched.isScrapeDue(1525) && sched.isChangeScrapeAllowed(1525));
+    sched.scrapeCompleted(1525, 0);
+    CHECK(!sched.changePending() && !sched.isScrapeDue(1526));
+
+    // Changes reported nonstop are coalesced, one scrape per interval.
+    int scrapes = 0;
+    for (uint32_t now = 1526; now < 1626; ++now) {
+        sched.notifyChange();
+        if (sched.isScrapeDue(now)) {
+            sched.scrapeCompleted(now, 0);
+            scrapes++;
+        }
+    }
+    CHECK(scrapes == 4);
+
+    // A blinking caret doesn't.
+    source.deliver({ caret(0, 0) });
+    CHECK(take(source).any);
+    sched.notifyChange();
+    sched.scrapeCompleted(1650, 0);
+    source.deliver({ caret(0, 0) });
+    CHECK(!take(source).any && !sched.isScrapeDue(1700));
+
+    // A hidden terminal still waits for its interval.
+    sched.setVisibility(ScrapeScheduler::Visibility::Hidden);
+    sched.notifyChange();
+    CHECK(!sched.isScrapeDue(1899));
+    CHECK(sched.isScrapeDue(1900));
+    sched.scrapeCompleted(1900, 0);
+    CHECK(!sched.isScrapeDue(2200));
+    CHECK(sched.isScrapeDue(2400));
+
+    // Explicit requests bypass the notifications.
+    sched.setVisibility(ScrapeScheduler::Visibility::Visible);
+    CHECK(sched.isScrapeDue(2401));
+    sched.scrapeCompleted(2401, 0);
+    sched.requestScrape();
+    CHECK(sched.isScrapeDue(2402));
+
+    // Frame credits still gate a pending change.
+    ScrapeScheduler credits;
+    credits.enableChangeNotifications();
+    credits.enableFrameCredits();
+    credits.notifyChange();
+    CHECK(!credits.isScrapeDue(0));
+    credits.grantFrameCredits(1);
+    CHECK(credits.isScrapeDue(0));
+
+    // Without notifications, a visible terminal is scraped every poll.
+    ScrapeScheduler polling;
+    polling.scrapeCompleted(1000, 0);
+    CHECK(polling.isScrapeDue(1025));
+}
+
+} // anonymous namespace
+
+int main() {
+    testRecorder();
+    testRowLimits();
+    testScheduler();
+    printf("ConsoleChangeSourceTest: all tests passed\n");
+    return 0;
+}
@@ -121,6 +121,28 @@ static int matchDsr(const char *input, int inputSize)
     return pch - input + 1;
 }
 
+// Match the DECRPM reply to a DECRQM query for a DEC private mode:
+// ESC [ ? nn ; mm $ y
+// Returns:
+// 0   no match
+// >0  match, returns length of match
+// -1  incomplete match
+static int matchDecrpm(const char *input, int inputSize,
+                       int32_t &mode, int32_t &value)
+{
+    const char *pch = input;
+    const char *stop = input + inputSize;
+    CHECK(*pch == '\x1B');  ADVANCE();
+    CHECK(*pch == '[');     ADVANCE();
+    CHECK(*pch == '?');     ADVANCE();
+    SCAN_INT(mode, 8);
+    CHECK(*pch == ';');     ADVANCE();
+    SCAN_INT(value, 8);
+    CHECK(*pch == '$');     ADVANCE();
+    CHECK(*pch == 'y');
+    return pch - input + 1;
+}
+
 static int matchMouseDefault(const char *input, int inputSize,
                              MouseRecord &out)
 {
@@ -229,11 +251,51 @@ ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
         if (!SetConsoleMode(conin, mode)) {
             trace("Agent startup: SetConsoleMode failed");
         }
+        m_initialConsoleMode = mode;
     }
 
+    // Passthrough is the default in escape-input mode.  The debug flag
+    // restores the decode-and-reencode behavior.
+    m_inputPassthrough = !hasDebugFlag("no_input_passthrough");
+
+    initPlainCharRecords();
     updateInputFlags(true);
 }
 
+// Typed or programmatically-sent text is mostly runs of printable ASCII.
+// Convert those characters once, here, so doWrite can copy their records in
+// bulk.  A character qualifies if the input map doesn't mention it (even as a
+// prefix) and typing it doesn't need Ctrl or AltGr.  VkKeyScan uses the
+// agent's keyboard layout, which doesn't change after startup.
+void ConsoleInput::initPlainCharRecords()
+{
+    // Tracing individual keypresses needs the slow path.
+    m_plainCharFastPath = !(isTracingEnabled() && hasDebugFlag("input"));
+    if (!m_plainCharFastPath) {
+        return;
+    }
+    const bool savedEscapeInput = m_escapeInputEnabled;
+    for (int escapeInput = 0; escapeInput < 2; ++escapeInput) {
+        m_escapeInputEnabled = (escapeInput != 0);
+        for (int ch = 0x20; ch < 0x7F; ++ch) {
+            const char input = static_cast<char>(ch);
+            InputMap::Key match;
+            bool incomplete;
+            if (m_inputMap.lookupKey(&input, 1, match, incomplete) > 0 ||
+                    incomplete) {
+                continue;
+            }
+            const short charScan = VkKeyScan(ch);
+            if (charScan == -1 || (charScan & 0x600) != 0) {
+                continue;
+            }
+            appendUtf8Char(m_plainCharRecords[escapeInput][ch],
+                           &input, 1, false);
+        }
+    }
+    m_escapeInputEnabled = savedEscapeInput;
+}
+
 void ConsoleInput::writeInput(const std::string &input)
 {
     if (input.size() == 0) {
@@ -279,6 +341,24 @@ void ConsoleInput::writeInput(const std::string &input)
     m_lastWriteTick = GetTickCount();
 }
 
+// Discard input meant for a previous child process, and restore the input
+// mode that it may have changed.
+void ConsoleInput::reset()
+{
+    m_byteQueue.clear();
+    m_mouseButtonState = 0;
+    m_doubleClick = DoubleClickDetection();
+    m_mouseMotion.reset();
+    if (!FlushConsoleInputBuffer(m_conin)) {
+        trace("reset: FlushConsoleInputBuffer failed");
+    }
+    if (m_initialConsoleMode != 0 &&
+            !SetConsoleMode(m_conin, m_initialConsoleMode)) {
+        trace("reset: SetConsoleMode failed");
+    }
+    updateInputFlags();
+}
+
 void ConsoleInput::flushIncompleteEscapeCode()
 {
     if (!m_byteQueue.empty() &&
@@ -310,6 +390,10 @@ void ConsoleInput::updateInputFlags(bool forceTrace)
     m_mouseInputEnabled = newFlagMI;
     m_quickEditEnabled = newFlagQE;
     m_escapeInputEnabled = newFlagEI;
+    if (!shouldActivateTerminalMouse()) {
+        // Judge the next mouse-aware app afresh.
+        m_mouseMotion.reset();
+    }
 }
 
 bool ConsoleInput::shouldActivateTerminalMouse()
@@ -331,12 +415,29 @@ bool ConsoleInput::shouldActivateTerminalMouse()
     }
 }
 
+// The number of input records the console app hasn't read yet.
+DWORD ConsoleInput::pendingRecordCount()
+{
+    DWORD count = 0;
+    if (!GetNumberOfConsoleInputEvents(m_conin, &count)) {
+        return 0;
+    }
+    return count;
+}
+
 void ConsoleInput::doWrite(bool isEof)
 {
     const char *data = m_byteQueue.c_str();
     std::vector<INPUT_RECORD> records;
     size_t idx = 0;
     while (idx < m_byteQueue.size()) {
+        if (!(m_escapeInputEnabled && m_inputPassthrough)) {
+            idx += appendPlainCharRun(records, &data[idx],
+                                      m_byteQueue.size() - idx);
+        }
+        if (idx == m_byteQueue.size()) {
+            break;
+        }
         int charSize = scanInput(records, &data[idx], m_byteQueue.size() - idx, isEof);
         if (charSize == -1)
             break;
@@ -351,6 +452,13 @@ void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
     if (records.size() == 0) {
         return;
     }
+    for (const auto &record : records) {
+        if (record.EventType == KEY_EVENT) {
+            // Output that follows could be a reaction to the keys.
+            m_mouseMotion.otherInputWritten();
+            break;
+        }
+    }
     DWORD actual = 0;
     if (!WriteConsoleInputW(m_conin, records.data(), records.size(), &actual)) {
         trace("WriteConsoleInputW failed");
@@ -358,6 +466,38 @@ void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
     records.clear();
 }
 
+// Convert a run of plain ASCII characters using the records precomputed by
+// initPlainCharRecords.  Returns the number of bytes consumed, which is zero
+// if the first character needs the general-purpose scanInput.
+size_t ConsoleInput::appendPlainCharRun(std::vector<INPUT_RECORD> &records,
+                                        const char *input,
+                                        size_t inputSize)
+{
+    if (!m_plainCharFastPath) {
+        return 0;
+    }
+    const auto &table = m_plainCharRecords[m_escapeInputEnabled ? 1 : 0];
+    size_t len = 0;
+    size_t recordCount = 0;
+    while (len < inputSize) {
+        const unsigned char ch = input[len];
+        if (ch >= 0x80 || table[ch].empty()) {
+            break;
+        }
+        recordCount += table[ch].size();
+        ++len;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    records.reserve(records.size() + recordCount);
+    for (size_t i = 0; i < len; ++i) {
+        const auto &charRecords = table[static_cast<unsigned char>(input[i])];
+        records.insert(records.end(), charRecords.begin(), charRecords.end());
+    }
+    return len;
+}
+
 // This behavior isn't strictly correct, because the keypresses (probably?)
 // adopt the keyboard state (e.g. Ctrl/Alt/Shift modifiers) of the current
 // window station's keyboard, which has no necessary relationship to the winpty
@@ -404,22 +544,14 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
     }
 
     if (input[0] == '\x1B') {
-        // Attempt to match the Device Status Report (DSR) reply.
-        int dsrLen = matchDsr(input, inputSize);
-        if (dsrLen > 0) {
-            trace("Received a DSR reply");
-            m_dsrSent = false;
-            return dsrLen;
-        } else if (!isEof && dsrLen == -1) {
-            // Incomplete DSR match.
-            trace("Incomplete DSR match");
-            return -1;
+        const int len = scanTerminalReply(records, input, inputSize, isEof);
+        if (len != 0) {
+            return len;
         }
+    }
 
-        int mouseLen = scanMouseInput(records, input, inputSize);
-        if (mouseLen > 0 || (!isEof && mouseLen == -1)) {
-            return mouseLen;
-        }
+    if (m_escapeInputEnabled && m_inputPassthrough) {
+        return scanPassthroughInput(records, input, inputSize, isEof);
     }
 
     // Search the input map.
@@ -485,6 +617,135 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
     return len;
 }
 
+// Match the terminal's replies to the agent's queries (DSR and DECRPM) and
+// mouse input, all of which start with ESC.  Returns the length of the match,
+// -1 if more input is needed, or 0 if the input is none of these.
+int ConsoleInput::scanTerminalReply(std::vector<INPUT_RECORD> &records,
+                                    const char *input,
+                                    int inputSize,
+                                    bool isEof)
+{
+    // Attempt to match the Device Status Report (DSR) reply.
+    int dsrLen = matchDsr(input, inputSize);
+    if (dsrLen > 0) {
+        trace("Received a DSR reply");
+        m_dsrSent = false;
+        return dsrLen;
+    } else if (!isEof && dsrLen == -1) {
+        // Incomplete DSR match.
+        trace("Incomplete DSR match");
+        return -1;
+    }
+
+    // Attempt to match the reply to Terminal::sendSyncOutputQuery.  A
+    // value of 1 (set), 2 (reset), or 3 (permanently set) means the
+    // terminal supports the mode.
+    int32_t mode = 0;
+    int32_t value = 0;
+    int decrpmLen = matchDecrpm(input, inputSize, mode, value);
+    if (decrpmLen > 0) {
+        trace("Received a DECRPM reply: mode=%d value=%d",
+              static_cast<int>(mode), static_cast<int>(value));
+        if (mode == 2026) {
+            m_dsrSender.setSyncOutputSupported(value >= 1 && value <= 3);
+        }
+        return decrpmLen;
+    } else if (!isEof && decrpmLen == -1) {
+        // Incomplete DECRPM match.
+        trace("Incomplete DECRPM match");
+        return -1;
+    }
+
+    int mouseLen = scanMouseInput(records, input, inputSize);
+    if (mouseLen > 0 || (!isEof && mouseLen == -1)) {
+        return mouseLen;
+    }
+
+    return 0;
+}
+
+// In escape-input mode, the console app decodes VT sequences itself, so pass
+// the terminal's bytes through as character key-down records, the same form
+// reencodeEscapedKeyPress produces.  The only key that still needs
+// translation is an unmodified arrow/Home/End key: appendKeyPress sends it to
+// the console window so that conhost encodes it according to DECCKM.  Input
+// is only held back while it could be the start of one of those sequences (or
+// a terminal reply), not for the escape timeout.
+int ConsoleInput::scanPassthroughInput(std::vector<INPUT_RECORD> &records,
+                                       const char *input,
+                                       int inputSize,
+                                       bool isEof)
+{
+    if (input[0] == '\x1B') {
+        InputMap::Key match;
+        bool incomplete;
+        const int matchLen =
+            m_inputMap.lookupKey(input, inputSize, match, incomplete);
+        if (!isEof && incomplete) {
+            trace("Incomplete escape sequence");
+            return -1;
+        }
+        const uint16_t kModifiers =
+            LEFT_CTRL_PRESSED | LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED |
+            SHIFT_PRESSED;
+        if (matchLen > 0 &&
+                (match.virtualKey == VK_UP ||
+                    match.virtualKey == VK_DOWN ||
+                    match.virtualKey == VK_LEFT ||
+                    match.virtualKey == VK_RIGHT ||
+                    match.virtualKey == VK_HOME ||
+                    match.virtualKey == VK_END) &&
+                (match.keyState & kModifiers) == 0) {
+            appendKeyPress(records, match.virtualKey,
+                           match.unicodeChar, match.unicodeChar,
+                           match.keyState,
+                           match.unicodeChar, match.keyState);
+            return matchLen;
+        }
+        appendInputRecord(records, TRUE, 0, L'\x1b', 0);
+        return 1;
+    }
+
+    // Pass through a run of ASCII bytes, stopping at anything that
+    // scanInput must look at (ESC, or Ctrl-C in processed mode).
+    const bool processed = (inputConsoleMode() & ENABLE_PROCESSED_INPUT) != 0;
+    int len = 0;
+    while (len < inputSize) {
+        const unsigned char ch = input[len];
+        if (ch >= 0x80 || ch == 0x1B || (ch == 0x03 && processed)) {
+            break;
+        }
+        appendInputRecord(records, TRUE, 0, ch, 0);
+        ++len;
+    }
+    if (len > 0) {
+        return len;
+    }
+
+    // A UTF-8 character.
+    static bool debugInput = isTracingEnabled() && hasDebugFlag("input");
+    const int charLen = utf8CharLength(input[0]);
+    if (charLen == 0) {
+        if (debugInput) {
+            trace("Discarding invalid input byte: %02X",
+                static_cast<unsigned char>(input[0]));
+        }
+        return 1;
+    }
+    if (charLen > inputSize) {
+        // Incomplete character.
+        trace("Incomplete UTF-8 character");
+        return -1;
+    }
+    const uint32_t codePoint = decodeUtf8(input);
+    if (codePoint != static_cast<uint32_t>(-1)) {
+        appendCPInputRecords(records, TRUE, 0, codePoint, 0);
+    } else if (debugInput) {
+        trace("Discarding invalid UTF-8 sequence");
+    }
+    return charLen;
+}
+
 int ConsoleInput::scanMouseInput(std::vector<INPUT_RECORD> &records,
                                  const char *input,
                                  int inputSize)
@@ -593,6 +854,11 @@ int ConsoleInput::scanMouseInput(std::vector<INPUT_RECORD> &records,
         }
 
         records.push_back(newRecord);
+        if (mer.dwEventFlags & MOUSE_MOVED) {
+            m_mouseMotion.motionWritten(GetTickCount());
+        } else {
+            m_mouseMotion.otherInputWritten();
+        }
     }
 
     return len;
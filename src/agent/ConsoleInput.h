@@ -30,6 +30,7 @@
 
 #include "Coord.h"
 #include "InputMap.h"
+#include "MouseMotionDetector.h"
 #include "SmallRect.h"
 
 class Win32Console;
@@ -41,18 +42,36 @@ public:
     ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
                  Win32Console &console);
     void writeInput(const std::string &input);
+    void reset();
     void flushIncompleteEscapeCode();
     void setMouseWindowRect(SmallRect val) { m_mouseWindowRect = val; }
     void updateInputFlags(bool forceTrace=false);
     bool shouldActivateTerminalMouse();
+    bool appConsumesMouseMotion() const {
+        return m_mouseMotion.appConsumesMotion();
+    }
+    void outputChanged() { m_mouseMotion.outputChanged(GetTickCount()); }
+    DWORD pendingRecordCount();
 
 private:
+    void initPlainCharRecords();
     void doWrite(bool isEof);
     void flushInputRecords(std::vector<INPUT_RECORD> &records);
+    size_t appendPlainCharRun(std::vector<INPUT_RECORD> &records,
+                              const char *input,
+                              size_t inputSize);
     int scanInput(std::vector<INPUT_RECORD> &records,
                   const char *input,
                   int inputSize,
                   bool isEof);
+    int scanTerminalReply(std::vector<INPUT_RECORD> &records,
+                          const char *input,
+                          int inputSize,
+                          bool isEof);
+    int scanPassthroughInput(std::vector<INPUT_RECORD> &records,
+                             const char *input,
+                             int inputSize,
+                             bool isEof);
     int scanMouseInput(std::vector<INPUT_RECORD> &records,
                        const char *input,
                        int inputSize);
@@ -86,6 +105,7 @@ private:
 private:
     Win32Console &m_console;
     HANDLE m_conin = nullptr;
+    DWORD m_initialConsoleMode = 0;
     int m_mouseMode = 0;
     DsrSender &m_dsrSender;
     bool m_dsrSent = false;
@@ -103,7 +123,15 @@ private:
     bool m_mouseInputEnabled = false;
     bool m_quickEditEnabled = false;
     bool m_escapeInputEnabled = false;
+    bool m_inputPassthrough = false;
     SmallRect m_mouseWindowRect;
+    MouseMotionDetector m_mouseMotion;
+
+    // Precomputed key events for the printable ASCII characters that need no
+    // special handling, indexed by [m_escapeInputEnabled][char].  An empty
+    // vector means the character must go through scanInput.
+    bool m_plainCharFastPath = false;
+    std::vector<INPUT_RECORD> m_plainCharRecords[2][128];
 };
 
 #endif // CONSOLEINPUT_H
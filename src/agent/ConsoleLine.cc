@@ -28,6 +28,8 @@
 
 #include "ConsoleLine.h"
 
+#include <string.h>
+
 #include <algorithm>
 
 #include "../shared/WinptyAssert.h"
@@ -43,10 +45,11 @@ static CHAR_INFO blankChar(WORD attributes)
     return ret;
 }
 
-static bool isLineBlank(const CHAR_INFO *line, int length, WORD attributes)
+static bool isLineBlank(const CHAR_INFO *line, int length, WORD attributes,
+                        WORD attributesMask)
 {
     for (int col = 0; col < length; ++col) {
-        if (line[col].Attributes != attributes ||
+        if (((line[col].Attributes ^ attributes) & attributesMask) != 0 ||
                 line[col].Char.UnicodeChar != L' ') {
             return false;
         }
@@ -62,6 +65,26 @@ static inline bool areLinesEqual(
     return memcmp(line1, line2, sizeof(CHAR_INFO) * length) == 0;
 }
 
+// Compare only the attribute bits in attributesMask.
+static bool areLinesEqual(
+    const CHAR_INFO *line1,
+    const CHAR_INFO *line2,
+    int length,
+    WORD attributesMask)
+{
+    if (attributesMask == static_cast<WORD>(~0)) {
+        return areLinesEqual(line1, line2, length);
+    }
+    for (int col = 0; col < length; ++col) {
+        if (line1[col].Char.UnicodeChar != line2[col].Char.UnicodeChar ||
+                ((line1[col].Attributes ^ line2[col].Attributes) &
+                    attributesMask) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 ConsoleLine::ConsoleLine() : m_prevLength(0)
 {
 }
@@ -76,16 +99,25 @@ void ConsoleLine::reset()
 // previously seen line as to justify reoutputting the line.  The function
 // also sets the `ConsoleLine` to the given line, exactly as if `setLine` had
 // been called.
-bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int newLength)
+//
+// Only the attribute bits in `attributesMask` are compared.  The terminal's
+// output doesn't depend on the other bits (e.g. the colors, in plain mode),
+// so a change confined to them doesn't reoutput the line, but the line is
+// still updated, so the history gets the final attributes.
+bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line,
+                                         const int newLength,
+                                         const WORD attributesMask)
 {
     ASSERT(newLength >= 1);
     ASSERT(m_prevLength <= static_cast<int>(m_prevData.size()));
 
     if (newLength == m_prevLength) {
-        bool equalLines = areLinesEqual(m_prevData.data(), line, newLength);
-        if (!equalLines) {
-            setLine(line, newLength);
+        if (areLinesEqual(m_prevData.data(), line, newLength)) {
+            return false;
         }
+        const bool equalLines = areLinesEqual(
+            m_prevData.data(), line, newLength, attributesMask);
+        setLine(line, newLength);
         return !equalLines;
     } else {
         if (m_prevLength == 0) {
@@ -102,10 +134,11 @@ bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int
             // The line has become shorter.  The lines are equal if the common
             // part is equal, and if the newly truncated characters were blank.
             equalLines =
-                areLinesEqual(m_prevData.data(), line, newLength) &&
+                areLinesEqual(m_prevData.data(), line, newLength,
+                              attributesMask) &&
                 isLineBlank(m_prevData.data() + newLength,
                             m_prevLength - newLength,
-                            newBlank);
+                            newBlank, attributesMask);
         } else {
             //
             // The line has become longer.  The lines are equal if the common
@@ -122,13 +155,14 @@ bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int
             //
             ASSERT(newLength > m_prevLength);
             equalLines =
-                areLinesEqual(m_prevData.data(), line, m_prevLength) &&
+                areLinesEqual(m_prevData.data(), line, m_prevLength,
+                              attributesMask) &&
                 isLineBlank(m_prevData.data() + m_prevLength,
                             std::min<int>(m_prevData.size(), newLength) - m_prevLength,
-                            prevBlank) &&
+                            prevBlank, attributesMask) &&
                 isLineBlank(line + m_prevLength,
                             newLength - m_prevLength,
-                            prevBlank);
+                            prevBlank, attributesMask);
         }
         setLine(line, newLength);
         return !equalLines;
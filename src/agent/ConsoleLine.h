@@ -30,9 +30,12 @@ class ConsoleLine
 public:
     ConsoleLine();
     void reset();
-    bool detectChangeAndSetLine(const CHAR_INFO *line, int newLength);
+    bool detectChangeAndSetLine(const CHAR_INFO *line, int newLength,
+                                WORD attributesMask=~0);
     void setLine(const CHAR_INFO *line, int newLength);
     void blank(WORD attributes);
+    const CHAR_INFO *data() const { return m_prevData.data(); }
+    int length() const { return m_prevLength; }
 private:
     int m_prevLength;
     std::vector<CHAR_INFO> m_prevData;
@@ -0,0 +1,119 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for ConsoleLine's change detection.  It only needs a
+// minimal <windows.h>, e.g.:
+//     g++ -std=c++11 -I../tests/common ConsoleLineTest.cc ConsoleLine.cc
+
+#include "ConsoleLine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../tests/common/TestCheck.h"
+
+void assertTrace(const char *file, int line, const char *cond) {
+    fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, cond);
+}
+
+namespace {
+
+// The masks Terminal::outputAttributesMask returns.
+const WORD kColorMask = 0xC0FF | 0x0300;
+const WORD kPlainMask = 0x0300;
+const WORD kLvbGridHorizontal = 0x0400;
+
+std::vector<CHAR_INFO> makeLine(const std::wstring &text, WORD attr,
+                                int width) {
+    std::vector<CHAR_INFO> ret(width);
+    for (int i = 0; i < width; ++i) {
+        ret[i].Char.UnicodeChar =
+            i < static_cast<int>(text.size()) ? text[i] : L' ';
+        ret[i].Attributes = attr;
+    }
+    return ret;
+}
+
+bool update(ConsoleLine &line, const std::vector<CHAR_INFO> &cells,
+            WORD mask) {
+    return line.detectChangeAndSetLine(cells.data(),
+                                       static_cast<int>(cells.size()), mask);
+}
+
+void testUnmasked() {
+    ConsoleLine line;
+    CHECK(update(line, makeLine(L"abc", 7, 10), 0xFFFF));
+    CHECK(!update(line, makeLine(L"abc", 7, 10), 0xFFFF));
+    CHECK(update(line, makeLine(L"abd", 7, 10), 0xFFFF));
+    CHECK(update(line, makeLine(L"abd", 7 | kLvbGridHorizontal, 10),
+                 0xFFFF));
+}
+
+void testColorMode() {
+    ConsoleLine line;
+    CHECK(update(line, makeLine(L"abc", 7, 10), kColorMask));
+    // LVB grid bits aren't output.
+    CHECK(!update(line, makeLine(L"abc", 7 | kLvbGridHorizontal, 10),
+                  kColorMask));
+    // ...but the line still records them.
+    CHECK(line.data()[0].Attributes == (7 | kLvbGridHorizontal));
+    // Colors and the DBCS bits are output.
+    CHECK(update(line, makeLine(L"abc", 0x0C, 10), kColorMask));
+    CHECK(update(line, makeLine(L"abc", 0x0C | 0x0100, 10), kColorMask));
+    CHECK(!update(line, makeLine(L"abc", 0x0C | 0x0100, 10), kColorMask));
+}
+
+void testPlainMode() {
+    ConsoleLine line;
+    CHECK(update(line, makeLine(L"abc", 7, 10), kPlainMask));
+    CHECK(!update(line, makeLine(L"abc", 0x1F, 10), kPlainMask));
+    CHECK(!update(line, makeLine(L"abc", 0x4F | kLvbGridHorizontal, 10),
+                  kPlainMask));
+    CHECK(update(line, makeLine(L"abx", 0x4F, 10), kPlainMask));
+}
+
+void testResize() {
+    // Shrinking past blanks that differ only in invisible bits isn't a
+    // change.
+    ConsoleLine line;
+    std::vector<CHAR_INFO> wide = makeLine(L"abc", 7, 10);
+    wide[8].Attributes = 0x17;
+    CHECK(update(line, wide, kPlainMask));
+    CHECK(!update(line, makeLine(L"abc", 7, 6), kPlainMask));
+    CHECK(!update(line, makeLine(L"abc", 0x17, 10), kPlainMask));
+
+    ConsoleLine colored;
+    CHECK(update(colored, wide, kColorMask));
+    CHECK(update(colored, makeLine(L"abc", 7, 6), kColorMask));
+}
+
+} // anonymous namespace
+
+int main() {
+    testUnmasked();
+    testColorMode();
+    testPlainMode();
+    testResize();
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -25,6 +25,7 @@ class DsrSender
 {
 public:
     virtual void sendDsr() = 0;
+    virtual void setSyncOutputSupported(bool supported) = 0;
 };
 
 #endif // DSRSENDER_H
@@ -0,0 +1,109 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "EncodedLineCache.h"
+
+#include <string.h>
+
+#include <iterator>
+#include <utility>
+
+uint64_t EncodedLineCache::hashLine(int variant, int startColor,
+                                    const CHAR_INFO *cells, int width)
+{
+    // FNV-1a over the cells, seeded with the encoder state.
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&](uint32_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    mix(static_cast<uint32_t>(variant));
+    mix(static_cast<uint32_t>(startColor));
+    mix(static_cast<uint32_t>(width));
+    for (int i = 0; i < width; ++i) {
+        mix((static_cast<uint32_t>(cells[i].Attributes) << 16) |
+            static_cast<uint16_t>(cells[i].Char.UnicodeChar));
+    }
+    return hash;
+}
+
+const EncodedLineCache::Entry *EncodedLineCache::find(
+    int variant, int startColor, const CHAR_INFO *cells, int width)
+{
+    const uint64_t hash = hashLine(variant, startColor, cells, width);
+    const auto range = m_index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry &entry = *it->second;
+        if (entry.variant == variant &&
+                entry.startColor == startColor &&
+                entry.cells.size() == static_cast<size_t>(width) &&
+                memcmp(entry.cells.data(), cells,
+                       sizeof(CHAR_INFO) * width) == 0) {
+            // Move the entry to the front without invalidating iterators.
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            m_hitCount++;
+            return &m_entries.front();
+        }
+    }
+    m_missCount++;
+    return nullptr;
+}
+
+void EncodedLineCache::insert(Entry &&entry)
+{
+    const size_t size = entrySize(entry);
+    if (size > m_maxBytes) {
+        return;
+    }
+    m_entries.push_front(std::move(entry));
+    m_index.emplace(m_entries.front().hash, m_entries.begin());
+    m_bytes += size;
+    evictToFit();
+}
+
+void EncodedLineCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+size_t EncodedLineCache::entrySize(const Entry &entry)
+{
+    return sizeof(Entry) +
+           entry.cells.size() * sizeof(CHAR_INFO) +
+           entry.bytes.size();
+}
+
+void EncodedLineCache::evictToFit()
+{
+    while (m_bytes > m_maxBytes) {
+        const auto last = std::prev(m_entries.end());
+        const auto range = m_index.equal_range(last->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == last) {
+                m_index.erase(it);
+                break;
+            }
+        }
+        m_bytes -= entrySize(*last);
+        m_entries.erase(last);
+    }
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_ENCODED_LINE_CACHE_H
+#define AGENT_ENCODED_LINE_CACHE_H
+
+#include <windows.h>
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A bounded LRU cache of terminal output for whole console lines, shared by
+// the agent's Terminal objects.  Repaints (after a reset, a resize, or a
+// direct-mode scroll) usually re-send lines the agent has encoded before, and
+// a hit turns the per-cell encoding into a memcmp and a copy.
+//
+// An entry is only valid for the encoder state it was produced in, so the
+// lookup key includes the encoding variant and the terminal's color before
+// the line.  The cells are stored and compared too, so a hash collision can't
+// produce wrong output.
+class EncodedLineCache
+{
+public:
+    struct Entry {
+        // Lookup fields.
+        uint64_t hash = 0;
+        int variant = 0;
+        int startColor = 0;
+        std::vector<CHAR_INFO> cells;
+
+        // The encoder's output and final state.
+        std::string bytes;
+        int endColor = 0;
+        int cellCount = 0;          // cells covered by the output
+        bool erasedLine = false;    // bytes already end the line with CSI 0K
+    };
+
+    explicit EncodedLineCache(size_t maxBytes=kDefaultMaxBytes) :
+        m_maxBytes(maxBytes) {}
+
+    const Entry *find(int variant, int startColor,
+                      const CHAR_INFO *cells, int width);
+    void insert(Entry &&entry);
+    void clear();
+
+    static uint64_t hashLine(int variant, int startColor,
+                             const CHAR_INFO *cells, int width);
+
+    uint64_t hitCount() const { return m_hitCount; }
+    uint64_t missCount() const { return m_missCount; }
+
+private:
+    static size_t entrySize(const Entry &entry);
+    void evictToFit();
+
+    static const size_t kDefaultMaxBytes = 4 * 1024 * 1024;
+
+    typedef std::list<Entry> EntryList;
+    const size_t m_maxBytes;
+    size_t m_bytes = 0;
+    EntryList m_entries;    // most recently used first
+    std::unordered_multimap<uint64_t, EntryList::iterator> m_index;
+    uint64_t m_hitCount = 0;
+    uint64_t m_missCount = 0;
+};
+
+#endif // AGENT_ENCODED_LINE_CACHE_H
@@ -50,6 +50,16 @@ void EventLoop::run()
             }
         }
 
+        // Handle signaled wait objects (e.g. an exited process).  The handler
+        // must remove an object that stays signaled.
+        for (size_t i = 0; i < m_waitObjects.size(); ++i) {
+            if (WaitForSingleObject(m_waitObjects[i], 0) == WAIT_OBJECT_0) {
+                onWaitObjectSignaled(m_waitObjects[i]);
+                didSomething = true;
+                break;
+            }
+        }
+
         // Call the timeout if enough time has elapsed.
         if (m_pollInterval > 0) {
             int elapsed = GetTickCount() - lastTime;
@@ -64,6 +74,8 @@ void EventLoop::run()
             continue;
 
         // If there's nothing to do, wait.
+        waitHandles.insert(waitHandles.end(),
+                           m_waitObjects.begin(), m_waitObjects.end());
         DWORD timeout = INFINITE;
         if (m_pollInterval > 0)
             timeout = std::max(0, (int)(lastTime + m_pollInterval - GetTickCount()));
@@ -93,6 +105,22 @@ void EventLoop::setPollInterval(int ms)
     m_pollInterval = ms;
 }
 
+// Wake the event loop when the handle is signaled, and call
+// onWaitObjectSignaled.
+void EventLoop::addWaitObject(HANDLE handle)
+{
+    ASSERT(std::find(m_waitObjects.begin(), m_waitObjects.end(), handle) ==
+           m_waitObjects.end());
+    m_waitObjects.push_back(handle);
+}
+
+void EventLoop::removeWaitObject(HANDLE handle)
+{
+    m_waitObjects.erase(
+        std::remove(m_waitObjects.begin(), m_waitObjects.end(), handle),
+        m_waitObjects.end());
+}
+
 void EventLoop::shutdown()
 {
     m_exiting = true;
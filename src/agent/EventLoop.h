@@ -21,6 +21,8 @@
 #ifndef EVENTLOOP_H
 #define EVENTLOOP_H
 
+#include <windows.h>
+
 #include <vector>
 
 class NamedPipe;
@@ -34,13 +36,17 @@ public:
 protected:
     NamedPipe &createNamedPipe();
     void setPollInterval(int ms);
+    void addWaitObject(HANDLE handle);
+    void removeWaitObject(HANDLE handle);
     void shutdown();
     virtual void onPollTimeout()                    {}
     virtual void onPipeIo(NamedPipe &namedPipe)     {}
+    virtual void onWaitObjectSignaled(HANDLE handle) {}
 
 private:
     bool m_exiting = false;
     std::vector<NamedPipe*> m_pipes;
+    std::vector<HANDLE> m_waitObjects;
     int m_pollInterval = 0;
 };
 
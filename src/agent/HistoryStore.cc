@@ -0,0 +1,392 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "HistoryStore.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "../shared/WinptyAssert.h"
+
+// A full line is encoded as:
+//     varint textLength << 1
+//     cells(textLength)
+// and a delta against the previous line as:
+//     varint prefixLength << 1 | 1
+//     varint suffixLength
+//     varint spanCount
+//     spanCount * (varint copyLength, varint changedLength,
+//                  changedLength ? cells(changedLength) : nothing)
+// where cells(n) is:
+//     varint runCount
+//     runCount * (varint runLength, uint16 attributes)
+//     n * uint16 code unit
+// with integers little-endian.
+//
+// A delta's line starts with the previous line's first prefixLength cells
+// and ends with its last suffixLength cells.  In between, each span copies
+// copyLength cells from the same columns of the previous line, then adds
+// changedLength new cells.  A runCount of zero means the new cells keep the
+// attributes of the previous line's cells in the same columns.
+
+namespace {
+
+// Trailing blanks in this color (LtGray-on-Black, the color the Scraper
+// gives the console) aren't stored.
+const WORD kBlankAttributes = 7;
+
+// Chunks are smaller with a small budget, so eviction stays fine-grained.
+// Line offsets within a chunk must fit in 16 bits.
+const size_t kMaxChunkBytes = 64 * 1024;
+
+// Within a delta, a run of unchanged cells shorter than this is cheaper to
+// store as changed cells than to copy with a new span.
+const size_t kMinCopyCells = 3;
+
+void putVarint(std::string &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putUInt16(std::string &out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+uint32_t getVarint(const std::string &in, size_t &pos) {
+    uint32_t ret = 0;
+    for (int shift = 0; ; shift += 7) {
+        ASSERT(pos < in.size() && shift < 32);
+        const uint8_t byte = static_cast<uint8_t>(in[pos++]);
+        ret |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return ret;
+        }
+    }
+}
+
+uint16_t getUInt16(const std::string &in, size_t &pos) {
+    ASSERT(pos + 2 <= in.size());
+    const uint16_t ret = static_cast<uint8_t>(in[pos]) |
+        (static_cast<uint8_t>(in[pos + 1]) << 8);
+    pos += 2;
+    return ret;
+}
+
+// Encodes cells [begin, end).  With inheritAttrs, the attributes are omitted
+// (a runCount of zero).
+void putCells(std::string &out,
+              const std::wstring &text,
+              const std::vector<uint16_t> &attrs,
+              size_t begin, size_t end,
+              bool inheritAttrs=false) {
+    uint32_t runCount = 0;
+    for (size_t i = begin; i < end && !inheritAttrs; ++i) {
+        if (i == begin || attrs[i] != attrs[i - 1]) {
+            ++runCount;
+        }
+    }
+    putVarint(out, runCount);
+    size_t runStart = begin;
+    for (size_t i = begin + 1; i <= end && !inheritAttrs; ++i) {
+        if (i == end || attrs[i] != attrs[runStart]) {
+            putVarint(out, static_cast<uint32_t>(i - runStart));
+            putUInt16(out, attrs[runStart]);
+            runStart = i;
+        }
+    }
+    for (size_t i = begin; i < end; ++i) {
+        putUInt16(out, text[i]);
+    }
+}
+
+// Appends count decoded cells to text and attrs.  With a runCount of zero,
+// the attributes come from inheritFrom, starting at the same column.
+void getCells(const std::string &in, size_t &pos, uint32_t count,
+              std::wstring &text, std::vector<uint16_t> &attrs,
+              const std::vector<uint16_t> *inheritFrom=nullptr) {
+    const uint32_t runCount = getVarint(in, pos);
+    const size_t attrsStart = attrs.size();
+    if (runCount == 0 && count > 0) {
+        ASSERT(inheritFrom != nullptr &&
+               attrsStart + count <= inheritFrom->size());
+        attrs.insert(attrs.end(),
+                     inheritFrom->begin() + attrsStart,
+                     inheritFrom->begin() + attrsStart + count);
+    }
+    for (uint32_t i = 0; i < runCount; ++i) {
+        const uint32_t length = getVarint(in, pos);
+        const uint16_t attributes = getUInt16(in, pos);
+        attrs.insert(attrs.end(), length, attributes);
+    }
+    ASSERT(attrs.size() - attrsStart == count);
+    for (uint32_t i = 0; i < count; ++i) {
+        text.push_back(getUInt16(in, pos));
+    }
+}
+
+// Encodes cur as a delta against prev.
+void putDelta(std::string &out,
+              const std::wstring &prevText,
+              const std::vector<uint16_t> &prevAttrs,
+              const std::wstring &curText,
+              const std::vector<uint16_t> &curAttrs) {
+    const size_t prevLen = prevText.size();
+    const size_t curLen = curText.size();
+    const size_t common = std::min(prevLen, curLen);
+    size_t prefix = 0;
+    while (prefix < common &&
+            prevText[prefix] == curText[prefix] &&
+            prevAttrs[prefix] == curAttrs[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix &&
+            prevText[prevLen - 1 - suffix] == curText[curLen - 1 - suffix] &&
+            prevAttrs[prevLen - 1 - suffix] == curAttrs[curLen - 1 - suffix]) {
+        ++suffix;
+    }
+
+    const size_t end = curLen - suffix;
+    const auto sameCell = [&](size_t i) {
+        return i < prevLen &&
+            prevText[i] == curText[i] && prevAttrs[i] == curAttrs[i];
+    };
+    const auto sameAttrs = [&](size_t begin, size_t stop) {
+        if (stop > prevLen) {
+            return false;
+        }
+        return std::equal(curAttrs.begin() + begin, curAttrs.begin() + stop,
+                          prevAttrs.begin() + begin);
+    };
+
+    std::string spans;
+    uint32_t spanCount = 0;
+    size_t pos = prefix;
+    while (pos < end) {
+        size_t changeStart = pos;
+        while (changeStart < end && sameCell(changeStart)) {
+            ++changeStart;
+        }
+        // The changed span ends before the next long-enough unchanged run.
+        size_t changeEnd = changeStart;
+        size_t sameRun = 0;
+        for (size_t i = changeStart; i < end && sameRun < kMinCopyCells; ++i) {
+            if (sameCell(i)) {
+                ++sameRun;
+            } else {
+                sameRun = 0;
+                changeEnd = i + 1;
+            }
+        }
+        putVarint(spans, static_cast<uint32_t>(changeStart - pos));
+        putVarint(spans, static_cast<uint32_t>(changeEnd - changeStart));
+        if (changeEnd > changeStart) {
+            putCells(spans, curText, curAttrs, changeStart, changeEnd,
+                     sameAttrs(changeStart, changeEnd));
+        }
+        ++spanCount;
+        pos = changeEnd;
+    }
+
+    putVarint(out, (static_cast<uint32_t>(prefix) << 1) | 1);
+    putVarint(out, static_cast<uint32_t>(suffix));
+    putVarint(out, spanCount);
+    out.append(spans);
+}
+
+} // anonymous namespace
+
+HistoryStore::HistoryStore(size_t maxBytes) :
+    m_maxBytes(maxBytes),
+    m_chunkBytes(std::max<size_t>(1, std::min(maxBytes / 16, kMaxChunkBytes)))
+{
+}
+
+void HistoryStore::append(const CHAR_INFO *cells, int width)
+{
+    while (width > 0 &&
+            cells[width - 1].Char.UnicodeChar == L' ' &&
+            cells[width - 1].Attributes == kBlankAttributes) {
+        --width;
+    }
+
+    Cells cur;
+    cur.text.resize(width);
+    cur.attrs.resize(width);
+    for (int i = 0; i < width; ++i) {
+        cur.text[i] = cells[i].Char.UnicodeChar;
+        cur.attrs[i] = cells[i].Attributes;
+    }
+
+    if (!m_chunks.empty() && m_chunks.back().size() >= m_chunkBytes) {
+        // Seal the full chunk.
+        std::string &chunk = m_chunks.back();
+        m_bytes -= chunk.capacity();
+        chunk.shrink_to_fit();
+        m_bytes += chunk.capacity();
+        startChunk();
+    } else if (m_chunks.empty()) {
+        startChunk();
+    }
+    std::string &chunk = m_chunks.back();
+    const size_t offset = chunk.size();
+    ASSERT(offset <= 0xFFFF);
+
+    std::string full;
+    putVarint(full, static_cast<uint32_t>(width) << 1);
+    putCells(full, cur.text, cur.attrs, 0, width);
+
+    std::string delta;
+    if (offset > 0 && m_deltaChain < kMaxDeltaChain) {
+        putDelta(delta, m_lastAppended.text, m_lastAppended.attrs,
+                 cur.text, cur.attrs);
+    }
+
+    m_bytes -= chunk.capacity();
+    if (!delta.empty() && delta.size() < full.size()) {
+        chunk.append(delta);
+        ++m_deltaChain;
+    } else {
+        chunk.append(full);
+        m_deltaChain = 0;
+    }
+    m_bytes += chunk.capacity() + sizeof(uint16_t);
+    m_lineOffsets.push_back(static_cast<uint16_t>(offset));
+    m_lastAppended = std::move(cur);
+
+    while (m_bytes > m_maxBytes && m_chunks.size() > 1) {
+        evictChunk();
+    }
+}
+
+void HistoryStore::readLine(int64_t line,
+                            std::wstring &textOut,
+                            std::vector<HistoryAttrRun> &runsOut) const
+{
+    ASSERT(line >= firstLine() && line < endLine());
+    if (line != m_lastReadLine) {
+        decodeLine(line, m_lastRead);
+        m_lastReadLine = line;
+    }
+    const Cells &cells = m_lastRead;
+    textOut = cells.text;
+    runsOut.clear();
+    for (size_t i = 0; i < cells.attrs.size(); ++i) {
+        if (i == 0 || cells.attrs[i] != cells.attrs[i - 1]) {
+            runsOut.push_back(HistoryAttrRun { 0, cells.attrs[i] });
+        }
+        runsOut.back().length++;
+    }
+}
+
+void HistoryStore::startChunk()
+{
+    m_chunks.emplace_back();
+    m_chunkFirstLines.push_back(endLine());
+    m_bytes += sizeof(std::string) + sizeof(int64_t);
+    m_deltaChain = 0;
+}
+
+size_t HistoryStore::chunkIndex(int64_t line) const
+{
+    const auto it = std::upper_bound(
+        m_chunkFirstLines.begin(), m_chunkFirstLines.end(), line);
+    ASSERT(it != m_chunkFirstLines.begin());
+    return (it - m_chunkFirstLines.begin()) - 1;
+}
+
+// Decodes forward from the nearest full line, or from the last line read if
+// it's closer.  out may be m_lastRead.
+void HistoryStore::decodeLine(int64_t line, Cells &out) const
+{
+    const std::string &chunk = m_chunks[chunkIndex(line)];
+    const auto lineOffset = [&](int64_t l) -> size_t {
+        return m_lineOffsets[l - m_firstLine];
+    };
+    const auto isDelta = [&](int64_t l) {
+        return (static_cast<uint8_t>(chunk[lineOffset(l)]) & 1) != 0;
+    };
+
+    int64_t start = line;
+    while (isDelta(start) && start - 1 != m_lastReadLine) {
+        --start;
+    }
+    Cells cur;
+    if (isDelta(start)) {
+        cur = m_lastRead;
+    }
+
+    Cells next;
+    for (int64_t l = start; l <= line; ++l) {
+        size_t pos = lineOffset(l);
+        const uint32_t header = getVarint(chunk, pos);
+        next.text.clear();
+        next.attrs.clear();
+        if ((header & 1) == 0) {
+            getCells(chunk, pos, header >> 1, next.text, next.attrs);
+        } else {
+            const size_t prefix = header >> 1;
+            const size_t suffix = getVarint(chunk, pos);
+            const uint32_t spanCount = getVarint(chunk, pos);
+            ASSERT(prefix + suffix <= cur.text.size());
+            next.text.assign(cur.text, 0, prefix);
+            next.attrs.assign(cur.attrs.begin(), cur.attrs.begin() + prefix);
+            for (uint32_t i = 0; i < spanCount; ++i) {
+                const size_t column = next.text.size();
+                const uint32_t copy = getVarint(chunk, pos);
+                const uint32_t changed = getVarint(chunk, pos);
+                ASSERT(column + copy <= cur.text.size());
+                next.text.append(cur.text, column, copy);
+                next.attrs.insert(next.attrs.end(),
+                                  cur.attrs.begin() + column,
+                                  cur.attrs.begin() + column + copy);
+                if (changed > 0) {
+                    getCells(chunk, pos, changed, next.text, next.attrs,
+                             &cur.attrs);
+                }
+            }
+            next.text.append(cur.text, cur.text.size() - suffix, suffix);
+            next.attrs.insert(next.attrs.end(),
+                              cur.attrs.end() - suffix, cur.attrs.end());
+        }
+        ASSERT(pos == (l + 1 < endLine() && lineOffset(l + 1) != 0 ?
+                       lineOffset(l + 1) : chunk.size()));
+        std::swap(cur, next);
+    }
+    out = std::move(cur);
+}
+
+void HistoryStore::evictChunk()
+{
+    ASSERT(m_chunks.size() > 1);
+    const int64_t stop = m_chunkFirstLines[1];
+    const size_t count = static_cast<size_t>(stop - m_firstLine);
+    m_bytes -= sizeof(std::string) + sizeof(int64_t) +
+        m_chunks.front().capacity() + count * sizeof(uint16_t);
+    m_lineOffsets.erase(m_lineOffsets.begin(),
+                        m_lineOffsets.begin() + count);
+    m_chunks.pop_front();
+    m_chunkFirstLines.pop_front();
+    m_firstLine = stop;
+}
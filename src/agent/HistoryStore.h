@@ -0,0 +1,100 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_HISTORY_STORE_H
+#define AGENT_HISTORY_STORE_H
+
+#include <windows.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+struct HistoryAttrRun {
+    uint32_t length;
+    uint16_t attributes;
+};
+
+// The lines that have scrolled out of the console window, kept so that a
+// client can page through old output on demand (winpty_read_history).  Lines
+// are numbered from zero in the order they were captured.  Each line is
+// stored as UTF-16 text plus attribute runs, packed into a few bytes of
+// variable-length integers per run, and trailing blanks in the default color
+// are dropped.
+//
+// Progress output tends to print lines that differ from the previous line in
+// only a few cells, so a line is stored as a delta against its predecessor
+// (the common prefix and suffix lengths plus the changed spans) when that is
+// smaller.  At most kMaxDeltaChain deltas follow a full line, which bounds
+// the cost of reading an arbitrary line, and sequential reads reuse the
+// previously decoded line.
+//
+// The encoded lines are packed into chunks of about m_chunkBytes, each
+// starting with a full line.  Once the store exceeds its byte budget, the
+// oldest chunks are discarded.
+class HistoryStore
+{
+public:
+    explicit HistoryStore(size_t maxBytes=kDefaultMaxBytes);
+
+    void append(const CHAR_INFO *cells, int width);
+    void readLine(int64_t line,
+                  std::wstring &textOut,
+                  std::vector<HistoryAttrRun> &runsOut) const;
+
+    int64_t firstLine() const { return m_firstLine; }
+    int64_t endLine() const { return m_firstLine + m_lineOffsets.size(); }
+    size_t byteSize() const { return m_bytes; }
+
+private:
+    // A decoded line, with one attribute per cell.
+    struct Cells {
+        std::wstring text;
+        std::vector<uint16_t> attrs;
+    };
+
+    void startChunk();
+    size_t chunkIndex(int64_t line) const;
+    void decodeLine(int64_t line, Cells &out) const;
+    void evictChunk();
+
+    static const size_t kDefaultMaxBytes = 16 * 1024 * 1024;
+    static const int kMaxDeltaChain = 128;
+
+    const size_t m_maxBytes;
+    const size_t m_chunkBytes;
+    size_t m_bytes = 0;
+    int64_t m_firstLine = 0;
+    std::deque<std::string> m_chunks;
+    std::deque<int64_t> m_chunkFirstLines;
+    std::deque<uint16_t> m_lineOffsets;
+
+    // The last line appended, and how many deltas follow the chunk's last
+    // full line.
+    Cells m_lastAppended;
+    int m_deltaChain = 0;
+
+    // The last line decoded by readLine.
+    mutable int64_t m_lastReadLine = -1;
+    mutable Cells m_lastRead;
+};
+
+#endif // AGENT_HISTORY_STORE_H
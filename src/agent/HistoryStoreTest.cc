@@ -0,0 +1,278 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for the history store.  It only needs a minimal
+// <windows.h>, e.g.:
+//     g++ -std=c++11 -I../tests/common HistoryStoreTest.cc HistoryStore.cc
+
+#include "HistoryStore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../tests/common/TestCheck.h"
+
+void assertTrace(const char *file, int line, const char *cond) {
+    fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, cond);
+}
+
+namespace {
+
+std::vector<CHAR_INFO> makeLine(const std::wstring &text,
+                                const std::vector<WORD> &attrs,
+                                int width) {
+    std::vector<CHAR_INFO> ret(width);
+    for (int i = 0; i < width; ++i) {
+        ret[i].Char.UnicodeChar =
+            i < static_cast<int>(text.size()) ? text[i] : L' ';
+        ret[i].Attributes =
+            i < static_cast<int>(attrs.size()) ? attrs[i] : 7;
+    }
+    return ret;
+}
+
+void append(HistoryStore &store, const std::vector<CHAR_INFO> &line) {
+    store.append(line.data(), static_cast<int>(line.size()));
+}
+
+// Expands a stored line back to cells, padding with default blanks.
+std::vector<CHAR_INFO> readCells(const HistoryStore &store, int64_t line,
+                                 int width) {
+    std::wstring text;
+    std::vector<HistoryAttrRun> runs;
+    store.readLine(line, text, runs);
+    size_t covered = 0;
+    for (const auto &run : runs) {
+        covered += run.length;
+    }
+    CHECK(covered == text.size());
+    CHECK(static_cast<int>(text.size()) <= width);
+    std::vector<WORD> attrs;
+    for (const auto &run : runs) {
+        attrs.insert(attrs.end(), run.length, run.attributes);
+    }
+    return makeLine(text, attrs, width);
+}
+
+bool sameCells(const std::vector<CHAR_INFO> &a,
+               const std::vector<CHAR_INFO> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].Char.UnicodeChar != b[i].Char.UnicodeChar ||
+                a[i].Attributes != b[i].Attributes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testRoundTrip() {
+    HistoryStore store;
+    const auto plain = makeLine(L"hello, world", {}, 80);
+    const auto colored = makeLine(
+        L"ab cd", { 0x0C, 0x0C, 0x07, 0x1F, 0x1F }, 80);
+    const auto trailingColor = makeLine(
+        L"x", std::vector<WORD>(80, 0x47), 80);
+    const auto blank = makeLine(L"", {}, 80);
+    append(store, plain);
+    append(store, colored);
+    append(store, trailingColor);
+    append(store, blank);
+    CHECK(store.firstLine() == 0 && store.endLine() == 4);
+    CHECK(sameCells(readCells(store, 0, 80), plain));
+    CHECK(sameCells(readCells(store, 1, 80), colored));
+    CHECK(sameCells(readCells(store, 2, 80), trailingColor));
+    CHECK(sameCells(readCells(store, 3, 80), blank));
+
+    std::wstring text;
+    std::vector<HistoryAttrRun> runs;
+    store.readLine(0, text, runs);
+    CHECK(text == L"hello, world");
+    CHECK(runs.size() == 1 && runs[0].length == 12 &&
+          runs[0].attributes == 7);
+    store.readLine(1, text, runs);
+    CHECK(text == L"ab cd" && runs.size() == 3);
+    store.readLine(3, text, runs);
+    CHECK(text.empty() && runs.empty());
+}
+
+void testEmptyLine() {
+    HistoryStore store;
+    store.append(nullptr, 0);
+    std::wstring text = L"junk";
+    std::vector<HistoryAttrRun> runs(3);
+    store.readLine(0, text, runs);
+    CHECK(text.empty() && runs.empty());
+}
+
+void testEviction() {
+    HistoryStore store(64 * 1024);
+    const auto line = makeLine(std::wstring(100, L'x'), {}, 120);
+    for (int i = 0; i < 10000; ++i) {
+        append(store, line);
+    }
+    CHECK(store.endLine() == 10000);
+    CHECK(store.firstLine() > 0);
+    CHECK(store.byteSize() <= 64 * 1024);
+    CHECK(sameCells(readCells(store, store.firstLine(), 120), line));
+    CHECK(sameCells(readCells(store, store.endLine() - 1, 120), line));
+}
+
+void testCompact() {
+    // A typical 80-column line of text takes little more than its text.
+    HistoryStore store;
+    const auto line = makeLine(L"C:\\src\\winpty> make -j8", {}, 80);
+    append(store, line);
+    CHECK(store.byteSize() < sizeof(std::string) + 64);
+}
+
+// A download's progress line, printed once per update.
+std::vector<CHAR_INFO> progressLine(int i, int width) {
+    const int percent = i % 101;
+    std::wstring text = L"Downloading winpty-0.4.3.tar.gz: ";
+    text += std::to_wstring(percent) + L"% [";
+    text += std::wstring(percent / 5, L'=') + L">";
+    text += std::wstring(20 - percent / 5, L' ') + L"] ";
+    text += std::to_wstring(i * 37) + L" KiB";
+    std::vector<WORD> attrs(text.size(), 7);
+    for (size_t j = 33; j < 37 && j < attrs.size(); ++j) {
+        attrs[j] = 0x0A;
+    }
+    return makeLine(text, attrs, width);
+}
+
+// A line's size before deltas: its string object, plus a buffer reserved for
+// the text and four bytes per attribute run.
+size_t undeltaedSize(const std::vector<CHAR_INFO> &line) {
+    size_t width = line.size();
+    while (width > 0 && line[width - 1].Char.UnicodeChar == L' ' &&
+            line[width - 1].Attributes == 7) {
+        --width;
+    }
+    size_t runs = 0;
+    for (size_t i = 0; i < width; ++i) {
+        if (i == 0 || line[i].Attributes != line[i - 1].Attributes) {
+            ++runs;
+        }
+    }
+    return sizeof(std::string) + 4 + runs * 4 + width * 2;
+}
+
+// A counter that ticks in place.
+std::vector<CHAR_INFO> counterLine(int i, int width) {
+    return makeLine(L"Compressing objects: " + std::to_wstring(i) +
+                    L" of 40000 done, please wait", {}, width);
+}
+
+void checkDeltas(const std::vector<std::vector<CHAR_INFO>> &lines,
+                 int width, size_t minRatio) {
+    HistoryStore store;
+    size_t undeltaedBytes = 0;
+    for (const auto &line : lines) {
+        append(store, line);
+        undeltaedBytes += undeltaedSize(line);
+    }
+    CHECK(store.endLine() == static_cast<int64_t>(lines.size()));
+    CHECK(store.byteSize() * minRatio < undeltaedBytes);
+
+    // Sequential reads, as a client paging forward.
+    for (size_t i = 0; i < lines.size(); ++i) {
+        CHECK(sameCells(readCells(store, i, width), lines[i]));
+    }
+    // Random reads and backward reads.
+    srand(1);
+    for (int i = 0; i < 2000; ++i) {
+        const size_t line = rand() % lines.size();
+        CHECK(sameCells(readCells(store, line, width), lines[line]));
+    }
+    for (size_t i = lines.size(); i-- > lines.size() - 300; ) {
+        CHECK(sameCells(readCells(store, i, width), lines[i]));
+    }
+}
+
+void testDelta() {
+    std::vector<std::vector<CHAR_INFO>> lines;
+    for (int i = 0; i < 20000; ++i) {
+        lines.push_back(counterLine(i, 80));
+    }
+    checkDeltas(lines, 80, 10);
+
+    // Two fields and a bar change on each line, with unrelated lines now
+    // and then.
+    lines.clear();
+    for (int i = 0; i < 20000; ++i) {
+        lines.push_back(progressLine(i, 80));
+        if (i % 500 == 0) {
+            lines.push_back(makeLine(L"Resolving host... done.", {}, 80));
+            lines.push_back(makeLine(L"", {}, 80));
+        }
+    }
+    checkDeltas(lines, 80, 8);
+
+    // Lines that share nothing are stored in full.
+    lines.clear();
+    for (int i = 0; i < 1000; ++i) {
+        std::wstring text;
+        for (int j = 0; j < 60; ++j) {
+            text.push_back(static_cast<wchar_t>(L'a' + (i * 7 + j * 3) % 26));
+        }
+        lines.push_back(makeLine(text, {}, 80));
+    }
+    checkDeltas(lines, 80, 1);
+}
+
+void testDeltaEviction() {
+    // Evicting a chunk never strands a delta without its base line.
+    HistoryStore store(32 * 1024);
+    std::vector<std::vector<CHAR_INFO>> lines;
+    for (int i = 0; i < 50000; ++i) {
+        lines.push_back(progressLine(i, 100));
+        append(store, lines.back());
+        CHECK(store.byteSize() <= 32 * 1024);
+        if (i % 997 == 0) {
+            const int64_t first = store.firstLine();
+            const int64_t line = first + rand() % (store.endLine() - first);
+            CHECK(sameCells(readCells(store, line, 100), lines[line]));
+            CHECK(sameCells(readCells(store, first, 100), lines[first]));
+        }
+    }
+    CHECK(store.firstLine() > 0);
+    for (int64_t i = store.firstLine(); i < store.endLine(); ++i) {
+        CHECK(sameCells(readCells(store, i, 100), lines[i]));
+    }
+}
+
+} // anonymous namespace
+
+int main() {
+    testRoundTrip();
+    testEmptyLine();
+    testEviction();
+    testCompact();
+    testDelta();
+    testDeltaEviction();
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "MouseMotionDetector.h"
+
+namespace {
+
+// Output later than this after the motion isn't counted as a reaction.
+const uint32_t kReactionWindowMs = 250;
+
+// The number of reactions that make the app a motion consumer.  One could be
+// a coincidence, e.g. a clock redrawing during the drag.
+const int kReactionsForAnyMotion = 3;
+
+} // anonymous namespace
+
+void MouseMotionDetector::motionWritten(uint32_t now)
+{
+    m_motionPending = true;
+    m_motionTime = now;
+}
+
+void MouseMotionDetector::outputChanged(uint32_t now)
+{
+    if (m_motionPending) {
+        // The tick count wraps every 49.7 days; unsigned subtraction
+        // handles it.
+        if (now - m_motionTime <= kReactionWindowMs) {
+            ++m_reactionCount;
+        }
+        m_motionPending = false;
+    }
+}
+
+bool MouseMotionDetector::appConsumesMotion() const
+{
+    return m_reactionCount >= kReactionsForAnyMotion;
+}
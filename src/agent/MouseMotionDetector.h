@@ -0,0 +1,51 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_MOUSE_MOTION_DETECTOR_H
+#define AGENT_MOUSE_MOTION_DETECTOR_H
+
+#include <stdint.h>
+
+// Decides whether the console app reacts to mouse motion.  The agent asks the
+// terminal for button-motion tracking (mode 1002), which only reports motion
+// while a button is held.  Any-motion tracking (mode 1003) reports every
+// movement over the terminal, which is wasted input traffic for most apps.
+//
+// The only motion the app sees in mode 1002 is a drag.  If the console output
+// changes shortly after a drag's MOUSE_MOVED record, and no other input came
+// in between, then the app reacted to the motion.  After a few reactions, the
+// app is assumed to want hover events too.  The detector is driven by a
+// millisecond tick count (e.g. GetTickCount).
+class MouseMotionDetector
+{
+public:
+    void motionWritten(uint32_t now);
+    void otherInputWritten() { m_motionPending = false; }
+    void outputChanged(uint32_t now);
+    bool appConsumesMotion() const;
+    void reset() { *this = MouseMotionDetector(); }
+
+private:
+    bool m_motionPending = false;
+    uint32_t m_motionTime = 0;
+    int m_reactionCount = 0;
+};
+
+#endif // AGENT_MOUSE_MOTION_DETECTOR_H
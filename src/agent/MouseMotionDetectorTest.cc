@@ -0,0 +1,91 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for MouseMotionDetector, e.g.:
+//     g++ -std=c++11 MouseMotionDetectorTest.cc MouseMotionDetector.cc
+
+#include "MouseMotionDetector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../tests/common/TestCheck.h"
+
+// Output soon after each drag motion.
+static void testReactions() {
+    MouseMotionDetector d;
+    d.motionWritten(1000);
+    d.outputChanged(1030);
+    d.motionWritten(1100);
+    d.outputChanged(1120);
+    CHECK(!d.appConsumesMotion());
+    d.motionWritten(1200);
+    d.outputChanged(1450);
+    CHECK(d.appConsumesMotion());
+    d.reset();
+    CHECK(!d.appConsumesMotion());
+}
+
+// Output that comes too late, or with no motion pending, isn't a reaction.
+static void testSlowOrUnrelatedOutput() {
+    MouseMotionDetector d;
+    for (int i = 0; i < 10; ++i) {
+        d.motionWritten(i * 1000);
+        d.outputChanged(i * 1000 + 251);
+        d.outputChanged(i * 1000 + 260);
+    }
+    CHECK(!d.appConsumesMotion());
+
+    // One motion followed by a steady redraw (e.g. a clock) counts once.
+    d.motionWritten(20000);
+    for (int i = 1; i <= 10; ++i) {
+        d.outputChanged(20000 + i * 10);
+    }
+    CHECK(!d.appConsumesMotion());
+}
+
+// A keypress after the motion could be the real cause of the output.
+static void testOtherInput() {
+    MouseMotionDetector d;
+    for (int i = 0; i < 10; ++i) {
+        d.motionWritten(i * 100);
+        d.otherInputWritten();
+        d.outputChanged(i * 100 + 10);
+    }
+    CHECK(!d.appConsumesMotion());
+}
+
+static void testTickWraparound() {
+    MouseMotionDetector d;
+    for (uint32_t i = 0; i < 3; ++i) {
+        d.motionWritten(0xFFFFFFF0u + i);
+        d.outputChanged(0x20 + i);
+    }
+    CHECK(d.appConsumesMotion());
+}
+
+int main() {
+    testReactions();
+    testSlowOrUnrelatedOutput();
+    testOtherInput();
+    testTickWraparound();
+    printf("All tests passed.\n");
+    return 0;
+}
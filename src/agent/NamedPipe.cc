@@ -296,6 +296,7 @@ void NamedPipe::write(const void *data, size_t size)
 {
     ASSERT(m_openMode & OpenMode::Writing);
     m_outQueue.append(reinterpret_cast<const char*>(data), size);
+    m_bytesWritten += size;
 }
 
 void NamedPipe::write(const char *text)
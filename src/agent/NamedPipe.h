@@ -22,6 +22,7 @@
 #define NAMEDPIPE_H
 
 #include <windows.h>
+#include <stdint.h>
 
 #include <memory>
 #include <string>
@@ -94,6 +95,7 @@ public:
                         int outBufferSize, int inBufferSize);
     void connectToServer(LPCWSTR pipeName, OpenMode::t openMode);
     size_t bytesToSend();
+    uint64_t bytesWritten() { return m_bytesWritten; }
     void write(const void *data, size_t size);
     void write(const char *text);
     size_t readBufferSize();
@@ -117,6 +119,7 @@ private:
     size_t m_readBufferSize = 64 * 1024;
     std::string m_inQueue;
     std::string m_outQueue;
+    uint64_t m_bytesWritten = 0;
     HANDLE m_handle = nullptr;
     std::unique_ptr<InputWorker> m_inputWorker;
     std::unique_ptr<OutputWorker> m_outputWorker;
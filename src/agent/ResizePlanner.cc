@@ -0,0 +1,89 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "ResizePlanner.h"
+
+#include <algorithm>
+
+bool planTemporaryWindow(const ResizeGeometry &geometry,
+                         const Coord &newBufferSize,
+                         const Coord &visibleSize,
+                         SmallRect &windowRectOut)
+{
+    const SmallRect &window = geometry.windowRect;
+    if (window.Left >= 0 && window.Top >= 0 &&
+            window.Right < newBufferSize.X &&
+            window.Bottom < newBufferSize.Y) {
+        return false;
+    }
+    const Coord &bufferSize = geometry.bufferSize;
+    const int width = std::min<int>(
+        std::min(bufferSize.X, newBufferSize.X), visibleSize.X);
+    const int height = std::min<int>(
+        std::min(bufferSize.Y, newBufferSize.Y), visibleSize.Y);
+    SmallRect rect(
+        0,
+        std::min<int>(std::min(bufferSize.Y, newBufferSize.Y) - height,
+                      window.Top),
+        width,
+        height);
+    if (geometry.cursorInWindow() &&
+            geometry.cursorPosition.Y < newBufferSize.Y) {
+        rect = rect.ensureLineIncluded(geometry.cursorPosition.Y);
+    }
+    windowRectOut = rect;
+    return true;
+}
+
+SmallRect planFinalWindow(const ResizeGeometry &geometry,
+                          const Coord &visibleSize,
+                          int dirtyLineCount)
+{
+    SmallRect rect(
+        0,
+        std::min<int>(geometry.bufferSize.Y - visibleSize.Y,
+                      geometry.windowRect.Top),
+        visibleSize.X,
+        visibleSize.Y);
+
+    //
+    // Once a line in the screen buffer is "dirty", it should stay visible
+    // in the console window, so that we continue to update its content in
+    // the terminal.  This code is particularly (only?) necessary on
+    // Windows 10, where making the buffer wider can rewrap lines and move
+    // the console window upward.
+    //
+    if (dirtyLineCount > rect.Bottom + 1) {
+        // In theory, we avoid ensureLineIncluded, because, a massive
+        // amount of output could have occurred while the console was
+        // unfrozen, so that the *top* of the window is now below the
+        // dirtiest tracked line.
+        rect = SmallRect(
+            0, dirtyLineCount - visibleSize.Y,
+            visibleSize.X, visibleSize.Y);
+    }
+
+    // Highest priority constraint: ensure that the cursor remains visible.
+    if (geometry.cursorInWindow()) {
+        rect = rect.ensureLineIncluded(geometry.cursorPosition.Y);
+    }
+
+    return rect;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_RESIZE_PLANNER_H
+#define AGENT_RESIZE_PLANNER_H
+
+#include "Coord.h"
+#include "SmallRect.h"
+
+// Decides which console operations a resize needs.  Each operation is a call
+// into conhost, and each change of the freeze state is a SendMessage to the
+// console window, so Scraper::resizeImpl skips the steps that would leave the
+// console as it is.  The planner only looks at the console's geometry, so it
+// can be tested without a console (see ResizePlannerTest.cc).
+
+struct ResizeGeometry {
+    Coord bufferSize;
+    SmallRect windowRect;
+    Coord cursorPosition;
+
+    bool cursorInWindow() const {
+        return cursorPosition.Y >= windowRect.Top &&
+               cursorPosition.Y <= windowRect.Bottom;
+    }
+};
+
+// SetConsoleScreenBufferSize fails if the window would not fit in the new
+// buffer, so the window may have to shrink first.  Returns false if the
+// current window already fits.  Otherwise, it stores the temporary window in
+// windowRectOut: no bigger than the final visible size, within both the old
+// and new buffers, and showing the cursor if it was visible.
+bool planTemporaryWindow(const ResizeGeometry &geometry,
+                         const Coord &newBufferSize,
+                         const Coord &visibleSize,
+                         SmallRect &windowRectOut);
+
+// The window once the buffer has its final size.  It keeps the window's top
+// row where possible, keeps the last dirty line visible (dirtyLineCount is -1
+// in direct mode, where lines are not tracked), and above all keeps the
+// cursor visible.  The caller moves the window only if this differs from
+// geometry.windowRect.
+SmallRect planFinalWindow(const ResizeGeometry &geometry,
+                          const Coord &visibleSize,
+                          int dirtyLineCount);
+
+#endif // AGENT_RESIZE_PLANNER_H
@@ -0,0 +1,269 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for the resize planner.  It runs resizes against a
+// simulated console, which rejects the same buffer and window changes that
+// conhost rejects, and counts the console calls and freeze toggles.  It only
+// needs a minimal <windows.h>, e.g.:
+//     g++ -std=c++11 -I../tests/common ResizePlannerTest.cc ResizePlanner.cc
+
+#include "ResizePlanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "../tests/common/TestCheck.h"
+
+namespace {
+
+struct SimConsole {
+    ResizeGeometry geometry;
+    Coord largest = Coord(200, 100);
+    bool frozen = true;
+    int fontColumns = -1;
+    int calls = 0;
+    int freezeToggles = 0;
+    int failures = 0;
+
+    void setFrozen(bool value) {
+        if (value != frozen) {
+            frozen = value;
+            freezeToggles++;
+        }
+    }
+
+    void setFont(int cols) {
+        CHECK(!frozen);
+        fontColumns = cols;
+        calls++;
+    }
+
+    void moveWindow(const SmallRect &rect) {
+        CHECK(frozen);
+        calls++;
+        if (rect.Left < 0 || rect.Top < 0 ||
+                rect.Right >= geometry.bufferSize.X ||
+                rect.Bottom >= geometry.bufferSize.Y ||
+                rect.width() > largest.X || rect.height() > largest.Y) {
+            failures++;
+            return;
+        }
+        geometry.windowRect = rect;
+    }
+
+    // SetConsoleScreenBufferSize fails unless the window fits in the buffer.
+    void resizeBuffer(const Coord &size) {
+        CHECK(!frozen);
+        calls++;
+        const SmallRect &window = geometry.windowRect;
+        if (window.Right >= size.X || window.Bottom >= size.Y) {
+            failures++;
+            return;
+        }
+        geometry.bufferSize = size;
+        geometry.cursorPosition.X =
+            std::min<int>(geometry.cursorPosition.X, size.X - 1);
+        geometry.cursorPosition.Y =
+            std::min<int>(geometry.cursorPosition.Y, size.Y - 1);
+    }
+};
+
+// The same sequence as Scraper::resizeImpl, minus the line tracking.
+void simulateResize(SimConsole &con, int cols, int rows, int dirtyLineCount) {
+    const ResizeGeometry orig = con.geometry;
+    const Coord finalBufferSize(
+        cols,
+        (orig.windowRect.height() == orig.bufferSize.Y)
+            ? rows
+            : std::max<int>(rows, orig.bufferSize.Y));
+    bool fontChanged = false;
+    if (con.fontColumns != cols) {
+        con.setFrozen(false);
+        con.setFont(cols);
+        fontChanged = true;
+    }
+    const Coord visibleSize(std::min<short>(cols, con.largest.X),
+                            std::min<short>(rows, con.largest.Y));
+    if (fontChanged || con.geometry.bufferSize != finalBufferSize) {
+        con.setFrozen(true);
+        SmallRect tmp;
+        if (planTemporaryWindow(con.geometry, finalBufferSize, visibleSize,
+                                tmp)) {
+            con.moveWindow(tmp);
+        }
+    }
+    if (con.geometry.bufferSize != finalBufferSize) {
+        con.setFrozen(false);
+        con.resizeBuffer(finalBufferSize);
+    }
+    con.setFrozen(true);
+    const SmallRect finalRect =
+        planFinalWindow(con.geometry, visibleSize, dirtyLineCount);
+    if (finalRect != con.geometry.windowRect) {
+        con.moveWindow(finalRect);
+    }
+}
+
+SimConsole scrollingConsole(int cols, int rows, int top, int cursorRow) {
+    SimConsole con;
+    con.geometry.bufferSize = Coord(cols, 3000);
+    con.geometry.windowRect = SmallRect(0, top, cols, rows);
+    con.geometry.cursorPosition = Coord(0, cursorRow);
+    con.fontColumns = cols;
+    return con;
+}
+
+void checkFinalState(const SimConsole &con, int cols, int rows,
+                     bool cursorWasVisible) {
+    CHECK(con.failures == 0);
+    CHECK(con.frozen);
+    CHECK(con.geometry.bufferSize.X == cols);
+    CHECK(con.geometry.windowRect.width() == std::min<int>(cols, con.largest.X));
+    CHECK(con.geometry.windowRect.height() == std::min<int>(rows, con.largest.Y));
+    CHECK(con.geometry.windowRect.Right < con.geometry.bufferSize.X);
+    CHECK(con.geometry.windowRect.Bottom < con.geometry.bufferSize.Y);
+    if (cursorWasVisible) {
+        CHECK(con.geometry.cursorInWindow());
+    }
+}
+
+void testSameSize() {
+    SimConsole con = scrollingConsole(80, 25, 100, 110);
+    simulateResize(con, 80, 25, 0);
+    checkFinalState(con, 80, 25, true);
+    CHECK(con.calls == 0);
+    CHECK(con.freezeToggles == 0);
+}
+
+void testTaller() {
+    // The buffer stays 3000 lines tall, so only the window moves, and the
+    // console stays frozen throughout.
+    SimConsole con = scrollingConsole(80, 25, 100, 124);
+    simulateResize(con, 80, 40, 0);
+    checkFinalState(con, 80, 40, true);
+    CHECK(con.calls == 1);
+    CHECK(con.freezeToggles == 0);
+}
+
+void testWider() {
+    // The window already fits in the wider buffer.
+    SimConsole con = scrollingConsole(80, 25, 100, 110);
+    con.fontColumns = 120;
+    simulateResize(con, 120, 25, 0);
+    checkFinalState(con, 120, 25, true);
+    CHECK(con.calls == 2);
+    CHECK(con.freezeToggles == 2);
+}
+
+void testNarrower() {
+    // The temporary window is already the final window.
+    SimConsole con = scrollingConsole(120, 30, 500, 529);
+    con.fontColumns = 80;
+    simulateResize(con, 80, 30, 0);
+    checkFinalState(con, 80, 30, true);
+    CHECK(con.calls == 2);
+    CHECK(con.freezeToggles == 2);
+}
+
+void testNewFont() {
+    SimConsole con = scrollingConsole(80, 25, 0, 3);
+    simulateResize(con, 100, 25, 0);
+    checkFinalState(con, 100, 25, true);
+    CHECK(con.fontColumns == 100);
+}
+
+void testDirectMode() {
+    // Without scrollback, the buffer follows the window height.
+    SimConsole con;
+    con.geometry.bufferSize = Coord(80, 25);
+    con.geometry.windowRect = SmallRect(0, 0, 80, 25);
+    con.geometry.cursorPosition = Coord(5, 24);
+    con.fontColumns = 80;
+    simulateResize(con, 80, 20, -1);
+    checkFinalState(con, 80, 20, false);
+    CHECK(con.geometry.bufferSize.Y == 20);
+    simulateResize(con, 80, 30, -1);
+    checkFinalState(con, 80, 30, false);
+    CHECK(con.geometry.bufferSize.Y == 30);
+}
+
+void testDirtyLinesStayVisible() {
+    // The cursor is below the window, so it doesn't pin the window.
+    SimConsole con = scrollingConsole(80, 25, 0, 100);
+    simulateResize(con, 80, 10, 40);
+    checkFinalState(con, 80, 10, false);
+    CHECK(con.geometry.windowRect.Bottom == 39);
+}
+
+void testLargerThanMonitor() {
+    SimConsole con = scrollingConsole(80, 25, 0, 0);
+    con.fontColumns = 300;
+    simulateResize(con, 300, 150, 0);
+    checkFinalState(con, 300, 150, true);
+    CHECK(con.geometry.windowRect.width() == 200);
+    CHECK(con.geometry.windowRect.height() == 100);
+}
+
+void testSweep() {
+    srand(1);
+    for (int i = 0; i < 20000; ++i) {
+        const bool direct = rand() % 3 == 0;
+        const int cols = 1 + rand() % 250;
+        const int rows = 1 + rand() % 120;
+        SimConsole con;
+        const int visCols = std::min(cols, 200);
+        const int visRows = std::min(rows, 100);
+        const int bufRows = direct ? visRows : 3000;
+        const int top = direct ? 0 : rand() % (bufRows - visRows + 1);
+        con.geometry.bufferSize = Coord(cols, bufRows);
+        con.geometry.windowRect = SmallRect(0, top, visCols, visRows);
+        con.geometry.cursorPosition =
+            Coord(rand() % cols, top + rand() % visRows);
+        con.fontColumns = rand() % 2 ? cols : -1;
+        const int newCols = 1 + rand() % 250;
+        const int newRows = 1 + rand() % 120;
+        simulateResize(con, newCols, newRows, -1);
+        checkFinalState(con, newCols, newRows, true);
+        // Resizing again to the same size changes nothing.
+        const int calls = con.calls;
+        const int toggles = con.freezeToggles;
+        simulateResize(con, newCols, newRows, -1);
+        CHECK(con.calls == calls);
+        CHECK(con.freezeToggles == toggles);
+    }
+}
+
+} // anonymous namespace
+
+int main() {
+    testSameSize();
+    testTaller();
+    testWider();
+    testNarrower();
+    testNewFont();
+    testDirectMode();
+    testDirtyLinesStayVisible();
+    testLargerThanMonitor();
+    testSweep();
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "ScrapeScheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+// A hidden terminal still receives its output, just in larger, less frequent
+// updates.  These intervals are long enough to make an idle-but-open session
+// nearly free, yet short enough that history capture (see
+// Scraper::isScrollbackAtRisk) rarely has to force a scrape.
+const uint32_t kHiddenScrapeIntervalMs = 250;
+const uint32_t kMinimizedScrapeIntervalMs = 1000;
+
+// With change notifications, how long to go without a scrape when the console
+// reports nothing.  It only matters if an event was missed.
+const uint32_t kSafetyScrapeIntervalMs = 500;
+
+// The shortest time between scrapes that a change notification can cause.  A
+// console with continuous output reports changes nonstop, and so do the
+// agent's own console writes (e.g. freezing it or writing a sync marker), so
+// without a limit, the agent could scrape more often than it used to poll.
+// Notifications arriving sooner are coalesced into the next scrape.
+const uint32_t kMinChangeScrapeIntervalMs = 25;
+
+// The shortest time between scrollback checks (see isRiskCheckDue).  The
+// hidden scrape interval rarely lets lines scroll away, so a few checks in
+// that time are plenty, while the agent polls several times as often.
+const uint32_t kMinRiskCheckIntervalMs = 100;
+
+void ScrapeScheduler::setVisibility(Visibility visibility)
+{
+    if (visibility == Visibility::Visible &&
+            m_visibility != Visibility::Visible) {
+        // Bring the terminal up-to-date right away, in a single update.
+        m_scrapeRequested = true;
+    }
+    m_visibility = visibility;
+}
+
+// The budget is a percentage of one CPU.  Zero means no limit.
+void ScrapeScheduler::setCpuBudget(int percent)
+{
+    m_cpuBudgetPercent = std::max(0, std::min(percent, 100));
+    m_cpuBalanceUsec = 0;
+}
+
+void ScrapeScheduler::grantFrameCredits(int credits)
+{
+    if (credits > 0) {
+        m_frameCredits = std::min<int64_t>(m_frameCredits + credits,
+                                          std::numeric_limits<int>::max());
+    }
+}
+
+void ScrapeScheduler::frameSent()
+{
+    if (m_frameCredits > 0) {
+        m_frameCredits--;
+    }
+}
+
+bool ScrapeScheduler::isScrapeDue(uint32_t now) const
+{
+    if (m_frameCreditMode && m_frameCredits == 0) {
+        return false;
+    }
+    if (m_cpuBudgetPercent != 0 && cpuBalance(now) < 0) {
+        return false;
+    }
+    if (m_scrapeRequested) {
+        return true;
+    }
+    // The tick count wraps every 49.7 days; unsigned subtraction handles it.
+    const uint32_t elapsed = now - m_lastScrapeTime;
+    if (m_changeNotifications) {
+        return elapsed >= std::max(scrapeInterval(),
+                                   m_changePending
+                                       ? kMinChangeScrapeIntervalMs
+                                       : kSafetyScrapeIntervalMs);
+    }
+    return elapsed >= scrapeInterval();
+}
+
+// Whether a pending change may be scraped now, ignoring the visibility
+// interval and the CPU and frame budgets.  It gates the scrollback check,
+// which can scrape early when lines are about to scroll out of the buffer.
+bool ScrapeScheduler::isChangeScrapeAllowed(uint32_t now) const
+{
+    return m_changePending &&
+        now - m_lastScrapeTime >= kMinChangeScrapeIntervalMs;
+}
+
+// Returns true if the scrape overdrew the CPU budget, delaying the next one.
+bool ScrapeScheduler::scrapeCompleted(uint32_t now, uint32_t cpuUsec)
+{
+    bool overBudget = false;
+    if (m_cpuBudgetPercent != 0) {
+        m_cpuBalanceUsec = cpuBalance(now) - cpuUsec;
+        m_cpuBalanceTime = now;
+        overBudget = m_cpuBalanceUsec < 0;
+    }
+    m_scrapeRequested = false;
+    m_changePending = false;
+    m_lastScrapeTime = now;
+    m_lastRiskCheckTime = now;
+    return overBudget;
+}
+
+// Whether the agent may check for lines about to scroll out of the console
+// buffer, to scrape before they're lost.  With change notifications, there's
+// nothing to check until the console has changed.
+bool ScrapeScheduler::isRiskCheckDue(uint32_t now) const
+{
+    if (m_changeNotifications && !isChangeScrapeAllowed(now)) {
+        return false;
+    }
+    return now - m_lastRiskCheckTime >= kMinRiskCheckIntervalMs;
+}
+
+void ScrapeScheduler::riskCheckCompleted(uint32_t now, uint32_t cpuUsec)
+{
+    if (m_cpuBudgetPercent != 0) {
+        m_cpuBalanceUsec = cpuBalance(now) - cpuUsec;
+        m_cpuBalanceTime = now;
+    }
+    m_lastRiskCheckTime = now;
+}
+
+int64_t ScrapeScheduler::cpuBalance(uint32_t now) const
+{
+    // A 1% budget refills at 10us per millisecond.  The balance only builds
+    // up to the capacity, but a deficit is repaid over as long as it takes, so
+    // even a scrape costing many seconds' worth of budget is eventually
+    // followed by another.
+    const int64_t capacity = m_cpuBudgetPercent * 10000;
+    const int64_t elapsed = now - m_cpuBalanceTime;
+    return std::min(capacity,
+                    m_cpuBalanceUsec + elapsed * m_cpuBudgetPercent * 10);
+}
+
+uint32_t ScrapeScheduler::scrapeInterval() const
+{
+    switch (m_visibility) {
+        case Visibility::Hidden:    return kHiddenScrapeIntervalMs;
+        case Visibility::Minimized: return kMinimizedScrapeIntervalMs;
+        default:                    return 0;
+    }
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_SCRAPE_SCHEDULER_H
+#define AGENT_SCRAPE_SCHEDULER_H
+
+#include <stdint.h>
+
+// Decides when the agent should scrape the console.  The agent's event loop
+// wakes up every poll interval to service input, but scraping is the
+// expensive part, so it is rate-limited separately.  The scheduler is driven
+// by a millisecond tick count (e.g. GetTickCount) so it has no dependency on
+// the console.
+//
+// With a CPU budget, the scheduler also keeps a balance of CPU time that
+// refills at the budgeted rate, up to one second's worth.  Each scrape's CPU
+// time is charged to it, and once it's overdrawn, no scrape is due until it
+// refills.  Expensive scrapes therefore happen less often, and the output
+// between them is coalesced into a single update.
+//
+// In frame-credit mode, the client paces the output instead.  Each scrape
+// that sends something to the terminal spends one credit, and with no credits
+// left, no scrape is due until the client grants more.  The next scrape then
+// sends the console's latest state, skipping the states in between.
+//
+// With change notifications, a scrape is only due once the console reports a
+// change (or a scrape is requested), and no sooner than the old poll interval
+// after the previous scrape.  The notifications aren't trusted completely, so
+// the console is still scraped occasionally without one.
+//
+// Between scrapes, the agent checks whether lines are about to scroll out of
+// the console buffer.  The check reads the console too, so it is rate-limited
+// and its CPU time is charged to the budget like a scrape's.
+class ScrapeScheduler
+{
+public:
+    enum class Visibility { Visible, Hidden, Minimized };
+
+    void setVisibility(Visibility visibility);
+    Visibility visibility() const { return m_visibility; }
+    void setCpuBudget(int percent);
+    void enableFrameCredits() { m_frameCreditMode = true; }
+    void grantFrameCredits(int credits);
+    void frameSent();
+    void requestScrape() { m_scrapeRequested = true; }
+    void enableChangeNotifications() { m_changeNotifications = true; }
+    void notifyChange() { m_changePending = true; }
+    bool changePending() const { return m_changePending; }
+    bool isChangeScrapeAllowed(uint32_t now) const;
+    bool isScrapeDue(uint32_t now) const;
+    bool scrapeCompleted(uint32_t now, uint32_t cpuUsec);
+    bool isRiskCheckDue(uint32_t now) const;
+    void riskCheckCompleted(uint32_t now, uint32_t cpuUsec);
+
+private:
+    uint32_t scrapeInterval() const;
+    int64_t cpuBalance(uint32_t now) const;
+
+    Visibility m_visibility = Visibility::Visible;
+    bool m_scrapeRequested = true;
+    uint32_t m_lastScrapeTime = 0;
+    uint32_t m_lastRiskCheckTime = 0;
+    int m_cpuBudgetPercent = 0;
+    int64_t m_cpuBalanceUsec = 0;
+    uint32_t m_cpuBalanceTime = 0;
+    bool m_frameCreditMode = false;
+    int64_t m_frameCredits = 0;
+    bool m_changeNotifications = false;
+    bool m_changePending = false;
+};
+
+#endif // AGENT_SCRAPE_SCHEDULER_H
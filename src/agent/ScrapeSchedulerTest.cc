@@ -0,0 +1,125 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for ScrapeScheduler, e.g.:
+//     g++ -std=c++11 ScrapeSchedulerTest.cc ScrapeScheduler.cc
+
+#include "ScrapeScheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../tests/common/TestCheck.h"
+
+static void testVisibility() {
+    ScrapeScheduler s;
+    CHECK(s.isScrapeDue(0));
+    s.scrapeCompleted(0, 0);
+    CHECK(s.isScrapeDue(1));
+    s.setVisibility(ScrapeScheduler::Visibility::Hidden);
+    s.scrapeCompleted(100, 0);
+    CHECK(!s.isScrapeDue(349));
+    CHECK(s.isScrapeDue(350));
+    s.setVisibility(ScrapeScheduler::Visibility::Visible);
+    CHECK(s.isScrapeDue(101));
+}
+
+static void testCpuBudget() {
+    ScrapeScheduler s;
+    s.setCpuBudget(10);
+    // The balance starts empty and refills at 100us per millisecond.
+    CHECK(s.isScrapeDue(0));
+    CHECK(s.scrapeCompleted(1000, 150000));
+    // 50ms in debt: due again after 500ms.
+    CHECK(!s.isScrapeDue(1499));
+    CHECK(s.isScrapeDue(1500));
+    CHECK(!s.scrapeCompleted(1500, 0));
+    CHECK(s.isScrapeDue(1500));
+}
+
+// A scrape costing more than the budget's capacity (here, 2.5x the 10ms a 1%
+// budget holds) must still be repaid eventually.
+static void testOverdrawnRecovery() {
+    ScrapeScheduler s;
+    s.setCpuBudget(1);
+    CHECK(s.scrapeCompleted(1000, 25000));
+    CHECK(!s.isScrapeDue(1001));
+    CHECK(!s.isScrapeDue(2499));
+    CHECK(s.isScrapeDue(2500));
+    CHECK(s.isScrapeDue(1000 + 3600 * 1000));
+
+    // A far larger overdraft, with the tick count wrapping while it's repaid.
+    ScrapeScheduler w;
+    w.setCpuBudget(1);
+    CHECK(w.scrapeCompleted(0xFFFFF000u, 100 * 1000 * 1000));
+    CHECK(!w.isScrapeDue(0xFFFFF000u + 9998 * 1000));
+    CHECK(w.isScrapeDue(0xFFFFF000u + 9999 * 1000));
+
+    // The balance never builds past its capacity, however long the wait.
+    CHECK(!w.scrapeCompleted(0xFFFFF000u + 20000 * 1000, 10000));
+    CHECK(w.scrapeCompleted(0xFFFFF000u + 20000 * 1000, 1));
+}
+
+// The scrollback check is rate-limited, and its CPU time delays the next
+// scrape like a scrape's own.
+static void testRiskCheck() {
+    ScrapeScheduler s;
+    s.setCpuBudget(10);
+    s.setVisibility(ScrapeScheduler::Visibility::Hidden);
+    s.scrapeCompleted(1000, 0);
+    CHECK(!s.isRiskCheckDue(1099));
+    CHECK(s.isRiskCheckDue(1100));
+    // The balance is full (100ms), so this leaves it 50ms in debt.
+    s.riskCheckCompleted(1100, 150000);
+    CHECK(!s.isRiskCheckDue(1199));
+    CHECK(s.isRiskCheckDue(1200));
+    // The hidden interval alone would allow a scrape at 1250.
+    CHECK(!s.isScrapeDue(1599));
+    CHECK(s.isScrapeDue(1600));
+
+    // With change notifications, there's nothing to check until a change.
+    ScrapeScheduler c;
+    c.enableChangeNotifications();
+    c.scrapeCompleted(1000, 0);
+    CHECK(!c.isRiskCheckDue(2000));
+    c.notifyChange();
+    CHECK(c.isRiskCheckDue(2000));
+}
+
+static void testFrameCredits() {
+    ScrapeScheduler s;
+    s.enableFrameCredits();
+    CHECK(!s.isScrapeDue(0));
+    s.grantFrameCredits(1);
+    CHECK(s.isScrapeDue(0));
+    s.frameSent();
+    s.scrapeCompleted(0, 0);
+    CHECK(!s.isScrapeDue(1000));
+}
+
+int main() {
+    testVisibility();
+    testCpuBudget();
+    testOverdrawnRecovery();
+    testRiskCheck();
+    testFrameCredits();
+    printf("All tests passed.\n");
+    return 0;
+}
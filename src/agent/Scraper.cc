@@ -27,10 +27,12 @@
 #include <algorithm>
 #include <utility>
 
+#include "../shared/DebugClient.h"
 #include "../shared/WinptyAssert.h"
 #include "../shared/winpty_snprintf.h"
 
 #include "ConsoleFont.h"
+#include "ResizePlanner.h"
 #include "Win32Console.h"
 #include "Win32ConsoleBuffer.h"
 
@@ -42,6 +44,29 @@ T constrained(T min, T val, T max) {
     return std::min(std::max(min, val), max);
 }
 
+// FNV-1a hash of a line's text.  The attributes are left out, because the
+// attributes mask can change between scrapes.
+uint64_t hashLineText(const CHAR_INFO *line, int width) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < width; ++i) {
+        hash ^= static_cast<uint16_t>(line[i].Char.UnicodeChar);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Only the attribute bits in attributesMask must match.
+bool isBlankLine(const CHAR_INFO *line, int width, WORD attributes,
+                 WORD attributesMask) {
+    for (int i = 0; i < width; ++i) {
+        if (line[i].Char.UnicodeChar != L' ' ||
+                ((line[i].Attributes ^ attributes) & attributesMask) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 } // anonymous namespace
 
 Scraper::Scraper(
@@ -53,6 +78,7 @@ Scraper::Scraper(
     m_terminal(std::move(terminal)),
     m_ptySize(initialSize)
 {
+    m_scrollAnchorEnabled = !hasDebugFlag("no_scroll_anchor");
     m_consoleBuffer = &buffer;
 
     resetConsoleTracking(Terminal::OmitClear, buffer.windowRect().top());
@@ -75,6 +101,8 @@ Scraper::Scraper(
     buffer.moveWindow(SmallRect(0, 0, 1, 1));
     buffer.resizeBufferRange(Coord(initialSize.X, BUFFER_LINE_COUNT));
     const auto largest = GetLargestConsoleWindowSize(buffer.conout());
+    m_fontColumns = initialSize.X;
+    m_fontLargestWindow = largest;
     buffer.moveWindow(SmallRect(
         0, 0,
         std::min(initialSize.X, largest.X),
@@ -113,6 +141,107 @@ void Scraper::scrapeBuffer(Win32ConsoleBuffer &buffer,
     m_consoleBuffer = nullptr;
 }
 
+// Returns true if the console has scrolled far enough since the last scrape
+// that postponing the next one could lose lines that have scrolled above the
+// window.  It is much cheaper than a scrape: it queries the buffer info and,
+// at most, reads the sync marker column.
+bool Scraper::isScrollbackAtRisk(Win32ConsoleBuffer &buffer)
+{
+    if (m_directMode) {
+        // There is no scrollback to lose in direct mode.
+        return false;
+    }
+
+    m_consoleBuffer = &buffer;
+    const ConsoleScreenBufferInfo info = m_consoleBuffer->bufferInfo();
+    bool ret = false;
+    if (info.bufferSize().Y == BUFFER_LINE_COUNT) {
+        const int newSyncRow = static_cast<int>(info.windowRect().top()) -
+            SYNC_MARKER_LEN - SYNC_MARKER_MARGIN;
+        if (newSyncRow >= m_syncRow + SYNC_MARKER_LEN + SYNC_MARKER_MARGIN) {
+            // The window has moved down far enough that the next scrape
+            // would place a new sync marker.  Place it now, before the
+            // console starts scrolling without one.
+            ret = true;
+        } else if (m_anchorRow != -1) {
+            // Once the anchor scrolls off the top of the buffer, or farther
+            // than findScrollAnchor trusts, we fall back to the sync marker,
+            // so scrape well before then.
+            int anchorRow = -1;
+            const int width = std::min<SHORT>(info.bufferSize().X,
+                                              MAX_CONSOLE_WIDTH);
+            const int trustedDistance =
+                m_anchorCheckedRows - SCROLL_ANCHOR_LEN;
+            ret = findScrollAnchor(width, anchorRow) != AnchorMatch::Found ||
+                (m_anchorRow - anchorRow) * 2 > m_anchorRow ||
+                (m_anchorRow - anchorRow) * 2 > trustedDistance;
+        } else if (m_syncRow != -1) {
+            // Once the marker scrolls off the top of the buffer, we lose
+            // track of the unscraped lines, so scrape well before then.
+            const int markerRow = findSyncMarker();
+            ret = markerRow == -1 || (m_syncRow - markerRow) * 2 > m_syncRow;
+        }
+    }
+    m_consoleBuffer = nullptr;
+    return ret;
+}
+
+// Record which terminal rows the client is displaying.  A rowCount of 0
+// means the client displays every row.
+void Scraper::setViewport(int firstRow, int rowCount)
+{
+    ASSERT(firstRow >= 0 && rowCount >= 0);
+    m_viewportFirstRow = firstRow;
+    m_viewportRowCount = rowCount;
+    // Scrape everything on the next scrape, in case the client has scrolled
+    // to rows that were being refreshed less often.
+    m_directScrapeCount = 0;
+}
+
+// Record console changes reported by a ConsoleChangeSource.  Without any,
+// every scrape reads the whole window.
+void Scraper::addChangeHint(const ConsoleChanges &changes)
+{
+    m_changeHint.merge(changes);
+}
+
+// Blank the console buffer for the next child process.  In scrolling mode,
+// the terminal keeps the previous output, and the next output starts below
+// the console cursor's line (or on it, if the cursor is at the start of the
+// line).  A full-screen (direct mode) buffer is restored to the scrolling
+// mode height, and the terminal is cleared.
+void Scraper::resetForNextProcess(Win32ConsoleBuffer &buffer)
+{
+    ASSERT(m_console.frozen());
+    m_consoleBuffer = &buffer;
+
+    const ConsoleScreenBufferInfo info = buffer.bufferInfo();
+    const SmallRect windowRect = info.windowRect();
+    Terminal::SendClearFlag sendClear = Terminal::SendClear;
+    if (!m_directMode) {
+        const Coord cursor = info.cursorPosition();
+        const int64_t nextLine =
+            cursor.Y + m_scrolledCount + (cursor.X > 0 ? 1 : 0);
+        m_terminal->beginFrame();
+        m_terminal->endFrame(true, 0, nextLine);
+        sendClear = Terminal::OmitClear;
+    }
+
+    buffer.setTextAttribute(Win32ConsoleBuffer::kDefaultAttributes);
+    if (info.bufferSize().Y != BUFFER_LINE_COUNT) {
+        buffer.resizeBufferRange(
+            Coord(info.bufferSize().X, BUFFER_LINE_COUNT));
+    }
+    buffer.moveWindow(
+        SmallRect(0, 0, windowRect.width(), windowRect.height()));
+    buffer.setCursorPosition(Coord(0, 0));
+    buffer.clearAllLines(buffer.bufferInfo());
+
+    m_directMode = false;
+    resetConsoleTracking(sendClear, 0);
+    m_consoleBuffer = nullptr;
+}
+
 void Scraper::resetConsoleTracking(
     Terminal::SendClearFlag sendClear, int64_t scrapedLineCount)
 {
@@ -120,11 +249,14 @@ void Scraper::resetConsoleTracking(
         line.reset();
     }
     m_syncRow = -1;
+    m_anchorRow = -1;
     m_scrapedLineCount = scrapedLineCount;
+    m_historyEnd = scrapedLineCount;
     m_scrolledCount = 0;
     m_maxBufferedLine = -1;
     m_dirtyWindowTop = -1;
     m_dirtyLineCount = 0;
+    m_changeHint.addFull();
     m_terminal->reset(sendClear, m_scrapedLineCount);
 }
 
@@ -177,18 +309,26 @@ void Scraper::clearBufferLines(
     }
 }
 
-static bool cursorInWindow(const ConsoleScreenBufferInfo &info)
+static ResizeGeometry resizeGeometry(const ConsoleScreenBufferInfo &info)
 {
-    return info.dwCursorPosition.Y >= info.srWindow.Top &&
-           info.dwCursorPosition.Y <= info.srWindow.Bottom;
+    ResizeGeometry ret;
+    ret.bufferSize = info.bufferSize();
+    ret.windowRect = info.windowRect();
+    ret.cursorPosition = info.cursorPosition();
+    return ret;
 }
 
+// Each step below is skipped when it would not change the console.  The
+// console starts and ends frozen, and it's only unfrozen for the font and
+// buffer changes, so a resize that needs neither never toggles the freeze.
 void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
 {
     ASSERT(m_console.frozen());
     const int cols = m_ptySize.X;
     const int rows = m_ptySize.Y;
     Coord finalBufferSize;
+    ResizeGeometry geometry = resizeGeometry(origInfo);
+    bool geometryStale = false;
 
     {
         //
@@ -209,12 +349,19 @@ void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
             for (ConsoleLine &line : m_bufferData) {
                 line.reset();
             }
+            m_changeHint.addFull();
         } else {
-            m_consoleBuffer->clearLines(0, origWindowRect.Top, origInfo);
+            if (origWindowRect.Top > 0) {
+                m_consoleBuffer->clearLines(0, origWindowRect.Top, origInfo);
+            }
             clearBufferLines(0, origWindowRect.Top);
-            if (m_syncRow != -1) {
+            // Blanking the history erases the content the scroll anchor
+            // matches, so switch to a sync marker.
+            const int syncRow = m_anchorRow != -1 ? m_anchorRow : m_syncRow;
+            m_anchorRow = -1;
+            if (syncRow != -1) {
                 createSyncMarker(std::min(
-                    m_syncRow,
+                    syncRow,
                     BUFFER_LINE_COUNT - rows
                                       - SYNC_MARKER_LEN
                                       - SYNC_MARKER_MARGIN));
@@ -229,7 +376,15 @@ void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
             (origWindowRect.height() == origBufferSize.Y)
                 ? rows
                 : std::max<int>(rows, origBufferSize.Y));
+    }
 
+    // We try to make the font small enough so that the entire screen buffer
+    // fits on the monitor, but it can't be guaranteed.  The largest window
+    // size depends on the font, so if it's unchanged since we last chose a
+    // font for this width, the font is still right.
+    auto largest = GetLargestConsoleWindowSize(m_consoleBuffer->conout());
+    if (cols != m_fontColumns || largest.X != m_fontLargestWindow.X ||
+            largest.Y != m_fontLargestWindow.Y) {
         // Reset the console font size.  We need to do this before shrinking
         // the window, because we might need to make the font bigger to permit
         // a smaller window width.  Making the font smaller could expand the
@@ -238,78 +393,48 @@ void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
         // unfreeze it first.
         m_console.setFrozen(false);
         setSmallFont(m_consoleBuffer->conout(), cols, m_console.isNewW10());
+        largest = GetLargestConsoleWindowSize(m_consoleBuffer->conout());
+        m_fontColumns = cols;
+        m_fontLargestWindow = largest;
+        geometryStale = true;
     }
+    const Coord visibleSize(std::min<short>(cols, largest.X),
+                            std::min<short>(rows, largest.Y));
 
-    // We try to make the font small enough so that the entire screen buffer
-    // fits on the monitor, but it can't be guaranteed.
-    const auto largest =
-        GetLargestConsoleWindowSize(m_consoleBuffer->conout());
-    const short visibleCols = std::min<short>(cols, largest.X);
-    const short visibleRows = std::min<short>(rows, largest.Y);
-
-    {
+    if (geometryStale || geometry.bufferSize != finalBufferSize) {
         // Make the window small enough.  We want the console frozen during
         // this step so we don't accidentally move the window above the cursor.
         m_console.setFrozen(true);
-        const auto info = m_consoleBuffer->bufferInfo();
-        const auto &bufferSize = info.dwSize;
-        const int tmpWindowWidth = std::min(bufferSize.X, visibleCols);
-        const int tmpWindowHeight = std::min(bufferSize.Y, visibleRows);
-        SmallRect tmpWindowRect(
-            0,
-            std::min<int>(bufferSize.Y - tmpWindowHeight,
-                          info.windowRect().Top),
-            tmpWindowWidth,
-            tmpWindowHeight);
-        if (cursorInWindow(info)) {
-            tmpWindowRect = tmpWindowRect.ensureLineIncluded(
-                info.cursorPosition().Y);
-        }
-        m_consoleBuffer->moveWindow(tmpWindowRect);
+        if (geometryStale) {
+            geometry = resizeGeometry(m_consoleBuffer->bufferInfo());
+            geometryStale = false;
+        }
+        SmallRect tmpWindowRect;
+        if (planTemporaryWindow(geometry, finalBufferSize, visibleSize,
+                                tmpWindowRect)) {
+            m_consoleBuffer->moveWindow(tmpWindowRect);
+            geometryStale = true;
+        }
     }
 
-    {
+    if (geometry.bufferSize != finalBufferSize) {
         // Resize the buffer to the final desired size.
         m_console.setFrozen(false);
         m_consoleBuffer->resizeBufferRange(finalBufferSize);
+        geometryStale = true;
     }
 
     {
         // Expand the window to its full size.
         m_console.setFrozen(true);
-        const ConsoleScreenBufferInfo info = m_consoleBuffer->bufferInfo();
-
-        SmallRect finalWindowRect(
-            0,
-            std::min<int>(info.bufferSize().Y - visibleRows,
-                          info.windowRect().Top),
-            visibleCols,
-            visibleRows);
-
-        //
-        // Once a line in the screen buffer is "dirty", it should stay visible
-        // in the console window, so that we continue to update its content in
-        // the terminal.  This code is particularly (only?) necessary on
-        // Windows 10, where making the buffer wider can rewrap lines and move
-        // the console window upward.
-        //
-        if (!m_directMode && m_dirtyLineCount > finalWindowRect.Bottom + 1) {
-            // In theory, we avoid ensureLineIncluded, because, a massive
-            // amount of output could have occurred while the console was
-            // unfrozen, so that the *top* of the window is now below the
-            // dirtiest tracked line.
-            finalWindowRect = SmallRect(
-                0, m_dirtyLineCount - visibleRows,
-                visibleCols, visibleRows);
+        if (geometryStale) {
+            geometry = resizeGeometry(m_consoleBuffer->bufferInfo());
         }
-
-        // Highest priority constraint: ensure that the cursor remains visible.
-        if (cursorInWindow(info)) {
-            finalWindowRect = finalWindowRect.ensureLineIncluded(
-                info.cursorPosition().Y);
+        const SmallRect finalWindowRect = planFinalWindow(
+            geometry, visibleSize, m_directMode ? -1 : m_dirtyLineCount);
+        if (finalWindowRect != geometry.windowRect) {
+            m_consoleBuffer->moveWindow(finalWindowRect);
         }
-
-        m_consoleBuffer->moveWindow(finalWindowRect);
         m_dirtyWindowTop = finalWindowRect.Top;
     }
 
@@ -375,6 +500,8 @@ void Scraper::syncConsoleContentAndSize(
         if (m_console.frozen()) {
             scrollingScrapeOutput(info, cursorVisible, false);
         }
+        // Scrolling mode always reads the whole window.
+        m_changeHint.clear();
         // In scrolling mode, we want to scrape before resizing, because we'll
         // erase everything in the console buffer up to the top of the console
         // window.
@@ -451,26 +578,151 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
     const int cursorColumn = !showTerminalCursor ? -1 : cursor.X - scrapeRect.Left;
     const int cursorLine = !showTerminalCursor ? -1 : cursor.Y - scrapeRect.Top;
 
-    if (!showTerminalCursor) {
-        m_terminal->hideTerminalCursor();
+    m_terminal->beginFrame();
+
+    // With a viewport hint, most scrapes only read the rows the client is
+    // displaying, plus the cursor's row, which is likely being edited.  A
+    // cursor row outside the viewport is read by itself, as the range
+    // [cursorFirstLine, cursorStopLine).  The viewport rows are clamped
+    // before adding them, because winpty_set_viewport accepts any
+    // nonnegative values.
+    int firstLine = 0;
+    int stopLine = h;
+    int cursorFirstLine = 0;
+    int cursorStopLine = 0;
+    if (m_viewportRowCount > 0 &&
+            m_directScrapeCount++ % FULL_DIRECT_SCRAPE_INTERVAL != 0) {
+        firstLine = std::min(m_viewportFirstRow, h);
+        stopLine = firstLine + std::min(m_viewportRowCount, h - firstLine);
+        const int line = cursor.Y - scrapeRect.Top;
+        if (scrapeRect.contains(cursor) &&
+                (line < firstLine || line >= stopLine)) {
+            cursorFirstLine = line;
+            cursorStopLine = line + 1;
+        }
+    }
+
+    // With change notifications, only the rows the console reported changed
+    // are read.  Changed rows that the viewport hint skipped stay in the hint
+    // for a later scrape.
+    if (scrapeRect != m_changeHintWindow) {
+        m_changeHint.addFull();
+        m_changeHintWindow = scrapeRect;
+    }
+    const bool hintConsumed =
+        m_changeHint.coversRows(scrapeRect.Top, h, firstLine, stopLine) ||
+        (cursorFirstLine < cursorStopLine &&
+         m_changeHint.coversRows(scrapeRect.Top, h,
+                                 cursorFirstLine, cursorStopLine));
+    m_changeHint.limitRows(scrapeRect.Top, firstLine, stopLine);
+    m_changeHint.limitRows(scrapeRect.Top, cursorFirstLine, cursorStopLine);
+    if (hintConsumed) {
+        m_changeHint.clear();
     }
 
-    largeConsoleRead(m_readBuffer, *m_consoleBuffer, scrapeRect, attributesMask());
+    if (firstLine < stopLine) {
+        largeConsoleRead(m_readBuffer, *m_consoleBuffer,
+                         SmallRect(scrapeRect.Left, scrapeRect.Top + firstLine,
+                                   w, stopLine - firstLine),
+                         attributesMask());
+    }
+    if (cursorFirstLine < cursorStopLine) {
+        largeConsoleRead(m_cursorReadBuffer, *m_consoleBuffer,
+                         SmallRect(scrapeRect.Left,
+                                   scrapeRect.Top + cursorFirstLine,
+                                   w, 1),
+                         attributesMask());
+    }
 
-    for (int line = 0; line < h; ++line) {
+    // Lines are compared as the terminal would output them.
+    const WORD outputMask = m_terminal->outputAttributesMask();
+    std::vector<bool> &changed = m_lineChangedWorkingBuffer;
+    changed.assign(h, false);
+    for (int line = firstLine; line < stopLine; ++line) {
         const CHAR_INFO *const curLine =
             m_readBuffer.lineData(scrapeRect.top() + line);
-        ConsoleLine &bufLine = m_bufferData[line];
-        if (bufLine.detectChangeAndSetLine(curLine, w)) {
+        changed[line] = m_bufferData[line].detectChangeAndSetLine(
+            curLine, w, outputMask);
+    }
+    for (int line = cursorFirstLine; line < cursorStopLine; ++line) {
+        const CHAR_INFO *const curLine =
+            m_cursorReadBuffer.lineData(scrapeRect.top() + line);
+        changed[line] = m_bufferData[line].detectChangeAndSetLine(
+            curLine, w, outputMask);
+    }
+
+    // When a run of blank lines at the bottom or top of the screen changed
+    // (e.g. the program cleared part of the screen), erase the run with a
+    // single command rather than a line at a time.  Every line in the run
+    // must be blank with the same attributes, because the erase blanks all
+    // of them, but the erase only needs to start at the first changed line.
+    int sendFirstLine = firstLine;
+    int sendStopLine = stopLine;
+    WORD eraseBelowAttributes = 0;
+    if (m_terminal->canEraseScreen() && firstLine < stopLine) {
+        if (stopLine == h) {
+            const WORD attr =
+                m_readBuffer.lineData(scrapeRect.top() + h - 1)[0].Attributes;
+            int changedCount = 0;
+            int eraseLine = -1;
+            for (int line = h - 1; line >= firstLine &&
+                    isBlankLine(m_readBuffer.lineData(scrapeRect.top() + line),
+                                w, attr, outputMask); --line) {
+                if (changed[line]) {
+                    ++changedCount;
+                    eraseLine = line;
+                }
+            }
+            if (changedCount >= MIN_BULK_ERASE_LINES) {
+                sendStopLine = eraseLine;
+                eraseBelowAttributes = attr;
+            }
+        }
+        if (firstLine == 0 && sendStopLine > 0) {
+            const WORD attr =
+                m_readBuffer.lineData(scrapeRect.top())[0].Attributes;
+            int changedCount = 0;
+            int eraseLine = -1;
+            for (int line = 0; line < sendStopLine &&
+                    isBlankLine(m_readBuffer.lineData(scrapeRect.top() + line),
+                                w, attr, outputMask); ++line) {
+                if (changed[line]) {
+                    ++changedCount;
+                    eraseLine = line;
+                }
+            }
+            if (changedCount >= MIN_BULK_ERASE_LINES) {
+                m_terminal->eraseScreen(Terminal::EraseAbove, eraseLine, attr);
+                sendFirstLine = eraseLine + 1;
+            }
+        }
+    }
+
+    for (int line = sendFirstLine; line < sendStopLine; ++line) {
+        if (changed[line]) {
+            const CHAR_INFO *const curLine =
+                m_readBuffer.lineData(scrapeRect.top() + line);
             const int lineCursorColumn =
                 line == cursorLine ? cursorColumn : -1;
             m_terminal->sendLine(line, curLine, w, lineCursorColumn);
         }
     }
+    // The cursor row is outside the erased runs, which are within
+    // [firstLine, stopLine).
+    for (int line = cursorFirstLine; line < cursorStopLine; ++line) {
+        if (changed[line]) {
+            const CHAR_INFO *const curLine =
+                m_cursorReadBuffer.lineData(scrapeRect.top() + line);
+            m_terminal->sendLine(line, curLine, w, cursorColumn);
+        }
+    }
 
-    if (showTerminalCursor) {
-        m_terminal->showTerminalCursor(cursorColumn, cursorLine);
+    if (sendStopLine < stopLine) {
+        m_terminal->eraseScreen(Terminal::EraseBelow, sendStopLine,
+                                eraseBelowAttributes);
     }
+
+    m_terminal->endFrame(showTerminalCursor, cursorColumn, cursorLine);
 }
 
 bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
@@ -480,7 +732,45 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     const Coord cursor = info.cursorPosition();
     const SmallRect windowRect = info.windowRect();
 
-    if (m_syncRow != -1) {
+    // Find out how far the console has scrolled since the last scrape.
+    // Prefer the content anchor, which doesn't require writing into the
+    // console, and fall back to the sync marker.
+    bool foundScrollPosition = false;
+    if (m_anchorRow != -1) {
+        const int width = std::min<SHORT>(info.bufferSize().X,
+                                          MAX_CONSOLE_WIDTH);
+        int anchorRow = -1;
+        const AnchorMatch match = findScrollAnchor(width, anchorRow);
+        if (match == AnchorMatch::Found) {
+            ASSERT(anchorRow <= m_anchorRow);
+            const int delta = m_anchorRow - anchorRow;
+            if (delta > 0) {
+                m_scrolledCount += delta;
+                m_anchorRow = anchorRow;
+                if (m_syncRow != -1) {
+                    // The marker scrolled with everything else.
+                    m_syncRow = m_syncRow >= delta ? m_syncRow - delta : -1;
+                }
+                // If the buffer has scrolled, then the entire window is
+                // dirty.
+                markEntireWindowDirty(windowRect);
+            }
+            foundScrollPosition = true;
+        } else {
+            if (tentative) {
+                return false;
+            }
+            trace("Scroll anchor is %s -- using the sync marker",
+                  match == AnchorMatch::Missing ? "missing" : "ambiguous");
+            m_anchorRow = -1;
+            if (m_syncRow == -1) {
+                trace("No sync marker -- resetting the terminal");
+                resetConsoleTracking(Terminal::SendClear, windowRect.top());
+            }
+        }
+    }
+
+    if (!foundScrollPosition && m_syncRow != -1) {
         // If a synchronizing marker was placed into the history, look for it
         // and adjust the scroll count.
         const int markerRow = findSyncMarker();
@@ -505,7 +795,11 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     }
 
     // Creating a new sync row requires clearing part of the console buffer, so
-    // avoid doing it if there's already a sync row that's good enough.
+    // avoid doing it if there's already a sync row that's good enough.  Keep
+    // one even while the content anchor is tracking the scroll position.  The
+    // anchor is only trusted to move about a window height between scrapes,
+    // and after a larger burst of output, the marker is the only way to find
+    // the lines that scrolled past.
     const int newSyncRow =
         static_cast<int>(windowRect.top()) - SYNC_MARKER_LEN - SYNC_MARKER_MARGIN;
     const bool shouldCreateSyncRow =
@@ -557,8 +851,14 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     // bottom of the window.  (It's not clear to me whether the
     // m_dirtyLineCount adjustment here is strictly necessary.  It isn't
     // necessary so long as the cursor is inside the current window.)
-    const int firstReadLine = std::min<int>(firstVirtLine - m_scrolledCount,
-                                            m_dirtyLineCount - 1);
+    int firstReadLine = std::min<int>(firstVirtLine - m_scrolledCount,
+                                      m_dirtyLineCount - 1);
+    if (m_scrollAnchorEnabled) {
+        // Also read the lines just above the window for a new scroll anchor.
+        firstReadLine = std::min<int>(
+            firstReadLine,
+            std::max<int>(0, windowRect.top() - SCROLL_ANCHOR_LEN));
+    }
     const int stopReadLine = std::max(windowRect.top() + windowRect.height(),
                                       m_dirtyLineCount);
     ASSERT(firstReadLine >= 0 && stopReadLine > firstReadLine);
@@ -582,7 +882,12 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                 info.cursorPosition() != infoCheck.cursorPosition()) {
             return false;
         }
-        if (m_syncRow != -1 && m_syncRow != findSyncMarker()) {
+        if (m_anchorRow != -1 &&
+                !isScrollAnchorAt(m_readBuffer.rect().width(), m_anchorRow)) {
+            return false;
+        }
+        if (m_anchorRow == -1 && m_syncRow != -1 &&
+                m_syncRow != findSyncMarker()) {
             return false;
         }
     }
@@ -611,9 +916,7 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     const int64_t cursorLine = !showTerminalCursor ? -1 : cursor.Y + m_scrolledCount;
     const int cursorColumn = !showTerminalCursor ? -1 : cursor.X;
 
-    if (!showTerminalCursor) {
-        m_terminal->hideTerminalCursor();
-    }
+    m_terminal->beginFrame();
 
     bool sawModifiedLine = false;
 
@@ -629,7 +932,8 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
         if (sawModifiedLine) {
             bufLine.setLine(curLine, w);
         } else {
-            sawModifiedLine = bufLine.detectChangeAndSetLine(curLine, w);
+            sawModifiedLine = bufLine.detectChangeAndSetLine(
+                curLine, w, m_terminal->outputAttributesMask());
         }
         if (sawModifiedLine) {
             const int lineCursorColumn =
@@ -639,14 +943,147 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     }
 
     m_scrapedLineCount = windowRect.top() + m_scrolledCount;
+    captureHistory(m_scrapedLineCount);
 
-    if (showTerminalCursor) {
-        m_terminal->showTerminalCursor(cursorColumn, cursorLine);
+    m_terminal->endFrame(showTerminalCursor, cursorColumn, cursorLine);
+
+    if (m_scrollAnchorEnabled) {
+        updateScrollAnchor(windowRect);
     }
 
     return true;
 }
 
+// Lines above the window are never scraped again, so their content in
+// m_bufferData is final.  Copy any that are new into the history store.
+void Scraper::captureHistory(int64_t stopVirtLine)
+{
+    m_historyEnd = std::max(m_historyEnd, stopVirtLine - BUFFER_LINE_COUNT);
+    for (; m_historyEnd < stopVirtLine; ++m_historyEnd) {
+        const ConsoleLine &line =
+            m_bufferData[m_historyEnd % BUFFER_LINE_COUNT];
+        m_history.append(line.data(), line.length());
+    }
+}
+
+// Look for the scroll anchor at or above the row where it was last seen.  The
+// console only scrolls upward, and it usually scrolls a little between
+// scrapes, so search the nearest rows first, starting with a small read.  A
+// second match in the same chunk makes the scroll distance ambiguous.
+//
+// The anchor was only checked for uniqueness against the rows below it that
+// were read when it was taken.  If the console scrolled farther than that,
+// output printed since then is also above the old anchor row, and it could
+// repeat the anchor closer to the window than the real one.  A match that far
+// up is also ambiguous.
+Scraper::AnchorMatch Scraper::findScrollAnchor(int width, int &rowOut)
+{
+    ASSERT(m_anchorRow >= 0);
+    if (width != m_anchorWidth) {
+        return AnchorMatch::Missing;
+    }
+    const int minTrustedRow =
+        m_anchorRow - (m_anchorCheckedRows - SCROLL_ANCHOR_LEN);
+
+    std::vector<uint64_t> &hashes = m_anchorLineHashes;
+    hashes.resize(m_anchorRow + SCROLL_ANCHOR_LEN);
+    int hashedTop = m_anchorRow + SCROLL_ANCHOR_LEN;
+    int found = -1;
+    int chunk = SCROLL_ANCHOR_LEN * 2;
+    while (found == -1 && hashedTop > 0) {
+        const int readTop = std::max(0, hashedTop - chunk);
+        chunk = SCROLL_ANCHOR_SEARCH_CHUNK;
+        largeConsoleRead(m_anchorReadBuffer, *m_consoleBuffer,
+                         SmallRect(0, readTop, width, hashedTop - readTop),
+                         static_cast<WORD>(~0));
+        for (int row = readTop; row < hashedTop; ++row) {
+            hashes[row] =
+                hashLineText(m_anchorReadBuffer.lineData(row), width);
+        }
+        for (int row = std::min(hashedTop - 1, m_anchorRow);
+                row >= readTop; --row) {
+            if (std::equal(m_anchorHashes,
+                           m_anchorHashes + SCROLL_ANCHOR_LEN,
+                           &hashes[row])) {
+                if (found != -1) {
+                    return AnchorMatch::Ambiguous;
+                }
+                found = row;
+            }
+        }
+        hashedTop = readTop;
+    }
+
+    if (found == -1) {
+        return AnchorMatch::Missing;
+    }
+    if (found < minTrustedRow) {
+        return AnchorMatch::Ambiguous;
+    }
+    rowOut = found;
+    return AnchorMatch::Found;
+}
+
+bool Scraper::isScrollAnchorAt(int width, int row)
+{
+    if (width != m_anchorWidth) {
+        return false;
+    }
+    largeConsoleRead(m_anchorReadBuffer, *m_consoleBuffer,
+                     SmallRect(0, row, width, SCROLL_ANCHOR_LEN),
+                     static_cast<WORD>(~0));
+    for (int i = 0; i < SCROLL_ANCHOR_LEN; ++i) {
+        if (hashLineText(m_anchorReadBuffer.lineData(row + i), width) !=
+                m_anchorHashes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Anchor on the lines just above the window.  The anchor must be distinctive
+// enough that the search won't stop on a copy of it, which could only come
+// from content below it, because the console scrolls upward.  Only the rows
+// read now can be checked, which limits how far findScrollAnchor will trust
+// the anchor to have scrolled.  Otherwise, keep the previous anchor, which was
+// found at the start of this scrape.
+void Scraper::updateScrollAnchor(const SmallRect &windowRect)
+{
+    const SmallRect &readRect = m_readBuffer.rect();
+    const int anchorRow = windowRect.top() - SCROLL_ANCHOR_LEN;
+    if (anchorRow < 1 || anchorRow < readRect.top() ||
+            anchorRow == m_anchorRow) {
+        return;
+    }
+
+    const int width = readRect.width();
+    std::vector<uint64_t> &hashes = m_anchorLineHashes;
+    hashes.clear();
+    for (int row = anchorRow; row <= readRect.Bottom; ++row) {
+        hashes.push_back(hashLineText(m_readBuffer.lineData(row), width));
+    }
+
+    std::vector<uint64_t> distinct(hashes.begin(),
+                                   hashes.begin() + SCROLL_ANCHOR_LEN);
+    std::sort(distinct.begin(), distinct.end());
+    if (std::unique(distinct.begin(), distinct.end()) - distinct.begin() <
+            SCROLL_ANCHOR_MIN_DISTINCT) {
+        return;
+    }
+    for (size_t i = 1; i + SCROLL_ANCHOR_LEN <= hashes.size(); ++i) {
+        if (std::equal(hashes.begin(), hashes.begin() + SCROLL_ANCHOR_LEN,
+                       hashes.begin() + i)) {
+            return;
+        }
+    }
+
+    m_anchorRow = anchorRow;
+    m_anchorWidth = width;
+    m_anchorCheckedRows = static_cast<int>(hashes.size());
+    std::copy(hashes.begin(), hashes.begin() + SCROLL_ANCHOR_LEN,
+              m_anchorHashes);
+}
+
 void Scraper::syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN])
 {
     // XXX: The marker text generated here could easily collide with ordinary
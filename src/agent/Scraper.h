@@ -28,8 +28,10 @@
 #include <memory>
 #include <vector>
 
+#include "ConsoleChangeSource.h"
 #include "ConsoleLine.h"
 #include "Coord.h"
+#include "HistoryStore.h"
 #include "LargeConsoleRead.h"
 #include "SmallRect.h"
 #include "Terminal.h"
@@ -47,6 +49,22 @@ const int MAX_CONSOLE_HEIGHT = 2000;
 const int SYNC_MARKER_LEN = 16;
 const int SYNC_MARKER_MARGIN = 200;
 
+// In direct mode with a viewport hint, rows outside the viewport are only
+// scraped on every Nth scrape.
+const int FULL_DIRECT_SCRAPE_INTERVAL = 8;
+
+// In scrolling mode, the scraper tracks scrolling by remembering the content
+// of SCROLL_ANCHOR_LEN lines just above the window and finding them again.
+// An anchor must contain at least SCROLL_ANCHOR_MIN_DISTINCT distinct lines.
+// The search reads the console SCROLL_ANCHOR_SEARCH_CHUNK lines at a time.
+const int SCROLL_ANCHOR_LEN = 16;
+const int SCROLL_ANCHOR_MIN_DISTINCT = 4;
+const int SCROLL_ANCHOR_SEARCH_CHUNK = 200;
+
+// In direct mode, a run of at least this many changed blank lines at the top
+// or bottom of the screen is erased with one command.
+const int MIN_BULK_ERASE_LINES = 2;
+
 class Scraper {
 public:
     Scraper(
@@ -60,7 +78,12 @@ public:
                       ConsoleScreenBufferInfo &finalInfoOut);
     void scrapeBuffer(Win32ConsoleBuffer &buffer,
                       ConsoleScreenBufferInfo &finalInfoOut);
+    bool isScrollbackAtRisk(Win32ConsoleBuffer &buffer);
+    void setViewport(int firstRow, int rowCount);
+    void addChangeHint(const ConsoleChanges &changes);
+    void resetForNextProcess(Win32ConsoleBuffer &buffer);
     Terminal &terminal() { return *m_terminal; }
+    const HistoryStore &history() const { return m_history; }
 
 private:
     void resetConsoleTracking(
@@ -77,6 +100,11 @@ private:
     bool scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                                bool consoleCursorVisible,
                                bool tentative);
+    enum class AnchorMatch { Found, Missing, Ambiguous };
+    AnchorMatch findScrollAnchor(int width, int &rowOut);
+    bool isScrollAnchorAt(int width, int row);
+    void updateScrollAnchor(const SmallRect &windowRect);
+    void captureHistory(int64_t stopVirtLine);
     void syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN]);
     int findSyncMarker();
     void createSyncMarker(int row);
@@ -89,15 +117,46 @@ private:
     int m_syncRow = -1;
     unsigned int m_syncCounter = 0;
 
+    bool m_scrollAnchorEnabled = true;
+    int m_anchorRow = -1;
+    int m_anchorWidth = 0;
+    uint64_t m_anchorHashes[SCROLL_ANCHOR_LEN] = {};
+    // The number of rows, starting at the anchor, that the anchor was checked
+    // for uniqueness against.
+    int m_anchorCheckedRows = 0;
+    std::vector<uint64_t> m_anchorLineHashes;
+    LargeConsoleReadBuffer m_anchorReadBuffer;
+
     bool m_directMode = false;
     Coord m_ptySize;
     int64_t m_scrapedLineCount = 0;
     int64_t m_scrolledCount = 0;
     int64_t m_maxBufferedLine = -1;
     LargeConsoleReadBuffer m_readBuffer;
+    LargeConsoleReadBuffer m_cursorReadBuffer;
     std::vector<ConsoleLine> m_bufferData;
+    std::vector<bool> m_lineChangedWorkingBuffer;
     int m_dirtyWindowTop = -1;
     int m_dirtyLineCount = 0;
+    int m_viewportFirstRow = 0;
+    int m_viewportRowCount = 0;
+    unsigned int m_directScrapeCount = 0;
+
+    // The console changes reported since the last scrape.  In direct mode,
+    // only the changed rows are read.  m_changeHintWindow is the window the
+    // unchanged rows were last read from.
+    ConsoleChanges m_changeHint;
+    SmallRect m_changeHintWindow;
+
+    // Lines leave the window into m_history.  m_historyEnd is the virtual
+    // line up to which they have been captured.
+    HistoryStore m_history;
+    int64_t m_historyEnd = 0;
+
+    // The width the console font was last chosen for, and the largest
+    // window size that font allowed.
+    int m_fontColumns = -1;
+    Coord m_fontLargestWindow;
 };
 
 #endif // AGENT_SCRAPER_H
@@ -25,10 +25,13 @@
 #include <string.h>
 
 #include <string>
+#include <utility>
 
+#include "EncodedLineCache.h"
 #include "NamedPipe.h"
 #include "UnicodeEncoding.h"
 #include "../shared/DebugClient.h"
+#include "../shared/StringUtil.h"
 #include "../shared/WinptyAssert.h"
 #include "../shared/winpty_snprintf.h"
 
@@ -298,18 +301,136 @@ static inline void scanUnicodeScalarValue(
     }
 }
 
+// Whether two runs of cells encode the same, given the attribute bits the
+// encoder looks at.
+static bool areCellsEquivalent(const CHAR_INFO *cells1,
+                               const CHAR_INFO *cells2,
+                               size_t count,
+                               WORD attributesMask)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (cells1[i].Char.UnicodeChar != cells2[i].Char.UnicodeChar ||
+                ((cells1[i].Attributes ^ cells2[i].Attributes) &
+                    attributesMask) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Convert the ASCII text appended to `out` since `start` into UTF-16LE.
+static void widenAsciiToUtf16(std::string &out, size_t start)
+{
+    const size_t len = out.size() - start;
+    out.resize(start + len * 2);
+    for (size_t i = len; i > 0; --i) {
+        out[start + (i - 1) * 2] = out[start + i - 1];
+        out[start + (i - 1) * 2 + 1] = '\0';
+    }
+}
+
+static inline void appendUtf16(std::string &out, wchar_t ch)
+{
+    out.push_back(static_cast<char>(ch & 0xFF));
+    out.push_back(static_cast<char>((ch >> 8) & 0xFF));
+}
+
 } // anonymous namespace
 
+Terminal::Terminal(NamedPipe &output, bool plainMode, bool outputColor,
+                   bool utf16Output, EncodedLineCache *lineCache)
+    : m_output(output), m_lineCache(lineCache), m_plainMode(plainMode),
+      m_outputColor(outputColor), m_utf16Output(utf16Output)
+{
+    // VT output always includes color.  The encoder only looks at the color
+    // bits, and at the DBCS bits to find full-width characters.  Cells
+    // differing only in other attribute bits produce the same output.
+    ASSERT(plainMode || outputColor);
+    m_outputAttributesMask =
+        WINPTY_COMMON_LVB_LEADING_BYTE | WINPTY_COMMON_LVB_TRAILING_BYTE;
+    if (outputColor) {
+        m_outputAttributesMask |= COLOR_ATTRIBUTE_MASK;
+    }
+}
+
+// Write ASCII text (e.g. an escape sequence) in the output encoding.
+void Terminal::write(const char *text)
+{
+    // The opener is itself widened in m_termWriteWorkingBuffer, so send it
+    // before the buffer holds this text.
+    openSyncUpdate();
+    if (!m_utf16Output) {
+        writeRaw(text, strlen(text));
+    } else {
+        std::string &buf = m_termWriteWorkingBuffer;
+        buf.assign(text);
+        widenAsciiToUtf16(buf, 0);
+        writeRaw(buf.data(), buf.size());
+    }
+}
+
+// Write already-encoded output.  The data must not be in
+// m_termWriteWorkingBuffer unless the frame's synchronized update is already
+// open.
+void Terminal::writeRaw(const char *data, size_t size)
+{
+    openSyncUpdate();
+    m_output.write(data, size);
+}
+
+// The first output of a frame opens a synchronized update, if the terminal
+// supports them.
+void Terminal::openSyncUpdate()
+{
+    if (m_inFrame && m_syncOutputSupported && !m_syncUpdateOpen) {
+        m_syncUpdateOpen = true;
+        write(CSI "?2026h");
+    }
+}
+
+void Terminal::beginFrame()
+{
+    m_inFrame = true;
+}
+
+// Bring the terminal's cursor to its final state for the frame.  The cursor
+// is hidden during the frame only if the frame moved it around, and it is
+// then shown once, here.
+void Terminal::endFrame(bool showCursor, int column, int64_t line)
+{
+    if (showCursor) {
+        moveTerminalToLine(line);
+        moveTerminalToColumn(column);
+        if (m_cursorHidden && !m_plainMode) {
+            write(CSI "?25h");
+            m_cursorHidden = false;
+        }
+    } else {
+        hideTerminalCursor();
+    }
+    if (m_syncUpdateOpen) {
+        write(CSI "?2026l");
+        m_syncUpdateOpen = false;
+    }
+    m_inFrame = false;
+}
+
+void Terminal::setSyncOutputSupported(bool supported)
+{
+    m_syncOutputSupported = supported && !m_plainMode;
+}
+
 void Terminal::reset(SendClearFlag sendClearFirst, int64_t newLine)
 {
     if (sendClearFirst == SendClear && !m_plainMode) {
         // 0m   ==> reset SGR parameters
         // 1;1H ==> move cursor to top-left position
         // 2J   ==> clear the entire screen
-        m_output.write(CSI "0m" CSI "1;1H" CSI "2J");
+        write(CSI "0m" CSI "1;1H" CSI "2J");
     }
     m_remoteLine = newLine;
     m_remoteColumn = 0;
+    m_remoteColumnAtEdge = false;
     m_lineData.clear();
     m_cursorHidden = false;
     m_remoteColor = -1;
@@ -320,7 +441,10 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
 {
     ASSERT(width >= 1);
 
-    moveTerminalToLine(line);
+    if (line != m_remoteLine) {
+        hideCursorDuringFrame();
+        moveTerminalToLine(line);
+    }
 
     // If possible, see if we can append to what we've already output for this
     // line.
@@ -339,38 +463,66 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
                 okWidth = static_cast<size_t>(width) > m_lineData.size();
             }
             if (!okWidth ||
-                    memcmp(m_lineData.data(), lineData,
-                           sizeof(CHAR_INFO) * m_lineData.size()) != 0) {
+                    !areCellsEquivalent(m_lineData.data(), lineData,
+                                        m_lineData.size(),
+                                        m_outputAttributesMask)) {
                 m_lineDataValid = false;
             }
         }
     }
     if (!m_lineDataValid) {
         // We can't reuse, so we must reset this line.
-        hideTerminalCursor();
+        hideCursorDuringFrame();
         if (m_plainMode) {
             // We can't backtrack, so repeat this line.
-            m_output.write("\r\n");
+            write("\r\n");
         } else {
-            m_output.write("\r");
+            write("\r");
         }
         m_lineDataValid = true;
         m_lineData.clear();
         m_remoteColumn = 0;
     }
 
+    // A line output from its first column is a candidate for the line
+    // cache.  The encoder's only other inputs are the output mode and the
+    // current color.
+    const int cacheVariant =
+        m_plainMode * 4 + m_outputColor * 2 + m_utf16Output;
+    const bool useCache = m_lineCache != nullptr && m_lineData.empty();
+    const EncodedLineCache::Entry *cached = nullptr;
+    if (useCache) {
+        cached = m_lineCache->find(cacheVariant, m_remoteColor,
+                                   lineData, width);
+    }
+
     std::string &termLine = m_termLineWorkingBuffer;
     termLine.clear();
     size_t trimmedLineLength = 0;
     int trimmedCellCount = m_lineData.size();
     bool alreadyErasedLine = false;
 
+    if (cached != nullptr) {
+        termLine.assign(cached->bytes);
+        trimmedLineLength = termLine.size();
+        trimmedCellCount = cached->cellCount;
+        alreadyErasedLine = cached->erasedLine;
+        m_remoteColor = cached->endColor;
+    }
+
+    const int startColor = m_remoteColor;
+    const int firstCell =
+        cached != nullptr ? width : static_cast<int>(m_lineData.size());
     int cellCount = 1;
-    for (int i = m_lineData.size(); i < width; i += cellCount) {
+    for (int i = firstCell; i < width; i += cellCount) {
         if (m_outputColor) {
             int color = lineData[i].Attributes & COLOR_ATTRIBUTE_MASK;
             if (color != m_remoteColor) {
+                const size_t sgrStart = termLine.size();
                 outputSetColor(termLine, color);
+                if (m_utf16Output) {
+                    widenAsciiToUtf16(termLine, sgrStart);
+                }
                 trimmedLineLength = termLine.size();
                 m_remoteColor = color;
 
@@ -383,7 +535,11 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
         if (ch == ' ') {
             // Tentatively add this space character.  We'll only output it if
             // we see something interesting after it.
-            termLine.push_back(' ');
+            if (m_utf16Output) {
+                appendUtf16(termLine, L' ');
+            } else {
+                termLine.push_back(' ');
+            }
         } else {
             if (i + cellCount == width) {
                 // We'd like to erase the line after outputting all non-blank
@@ -394,18 +550,35 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
                 // the line.  Work around this behavior by issuing the erase
                 // one character early in that case.
                 if (!m_plainMode) {
+                    const size_t eraseStart = termLine.size();
                     termLine.append(CSI "0K"); // Erase from cursor to EOL
+                    if (m_utf16Output) {
+                        widenAsciiToUtf16(termLine, eraseStart);
+                    }
                 }
                 alreadyErasedLine = true;
             }
             ch = fixSpecialCharacters(ch);
-            char enc[4];
-            int enclen = encodeUtf8(enc, ch);
-            if (enclen == 0) {
-                enc[0] = '?';
-                enclen = 1;
+            if (m_utf16Output) {
+                // BMP characters are copied from the console cell as-is.
+                wchar_t enc[2];
+                int enclen = encodeUtf16(enc, ch);
+                if (enclen == 0) {
+                    enc[0] = L'?';
+                    enclen = 1;
+                }
+                for (int j = 0; j < enclen; ++j) {
+                    appendUtf16(termLine, enc[j]);
+                }
+            } else {
+                char enc[4];
+                int enclen = encodeUtf8(enc, ch);
+                if (enclen == 0) {
+                    enc[0] = '?';
+                    enclen = 1;
+                }
+                termLine.append(enc, enclen);
             }
-            termLine.append(enc, enclen);
             trimmedLineLength = termLine.size();
 
             // All the cells up to and including this cell will be output.
@@ -413,15 +586,29 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
         }
     }
 
+    if (useCache && cached == nullptr) {
+        EncodedLineCache::Entry entry;
+        entry.hash = EncodedLineCache::hashLine(cacheVariant, startColor,
+                                                lineData, width);
+        entry.variant = cacheVariant;
+        entry.startColor = startColor;
+        entry.cells.assign(lineData, lineData + width);
+        entry.bytes.assign(termLine, 0, trimmedLineLength);
+        entry.endColor = m_remoteColor;
+        entry.cellCount = trimmedCellCount;
+        entry.erasedLine = alreadyErasedLine;
+        m_lineCache->insert(std::move(entry));
+    }
+
     if (cursorColumn != -1 && trimmedCellCount > cursorColumn) {
         // The line content would run past the cursor, so hide it before we
         // output.
-        hideTerminalCursor();
+        hideCursorDuringFrame();
     }
 
-    m_output.write(termLine.data(), trimmedLineLength);
+    writeRaw(termLine.data(), trimmedLineLength);
     if (!alreadyErasedLine && !m_plainMode) {
-        m_output.write(CSI "0K"); // Erase from cursor to EOL
+        write(CSI "0K"); // Erase from cursor to EOL
     }
 
     ASSERT(trimmedCellCount <= width);
@@ -429,24 +616,92 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
                       &lineData[m_lineData.size()],
                       &lineData[trimmedCellCount]);
     m_remoteColumn = trimmedCellCount;
+    m_remoteColumnAtEdge = trimmedCellCount >= width;
 }
 
-void Terminal::showTerminalCursor(int column, int64_t line)
+// Blank the rows from `line` to the bottom of the screen (EraseBelow), or from
+// the top of the screen through `line` (EraseAbove), using the background
+// color of `attributes`.  This replaces a sendLine call for each blank row.
+void Terminal::eraseScreen(EraseDirection direction, int64_t line,
+                           WORD attributes)
 {
-    moveTerminalToLine(line);
-    if (!m_plainMode) {
-        if (m_remoteColumn != column) {
-            char buffer[32];
-            winpty_snprintf(buffer, CSI "%dG", column + 1);
-            m_output.write(buffer);
-            m_lineDataValid = (column == 0);
-            m_lineData.clear();
-            m_remoteColumn = column;
-        }
-        if (m_cursorHidden) {
-            m_output.write(CSI "?25h");
-            m_cursorHidden = false;
-        }
+    ASSERT(!m_plainMode);
+
+    if (line != m_remoteLine) {
+        hideCursorDuringFrame();
+        moveTerminalToLine(line);
+    }
+    moveTerminalToColumn(0);
+
+    const int color = attributes & COLOR_ATTRIBUTE_MASK;
+    if (color != m_remoteColor) {
+        std::string sgr;
+        outputSetColor(sgr, color);
+        write(sgr.c_str());
+        m_remoteColor = color;
+    }
+
+    if (direction == EraseBelow) {
+        write(CSI "0J"); // Erase from cursor to end of screen
+    } else {
+        // ED 1 erases through the cursor's cell, so erase the rest of the
+        // cursor's line separately.
+        write(CSI "1J" CSI "0K");
+    }
+}
+
+// Move the cursor to the given column of the current line using the
+// shortest sequence.  Relative moves are avoided when the cursor might be in
+// the "pending wrap" state after writing the last column, because terminals
+// disagree on where it is then.
+void Terminal::moveTerminalToColumn(int column)
+{
+    if (m_plainMode || column == m_remoteColumn) {
+        return;
+    }
+
+    const int delta = column - m_remoteColumn;
+    const unsigned int distance = delta < 0 ? -delta : delta;
+    const unsigned int absolute = column + 1;
+    if (column == 0) {
+        write("\r");
+    } else if (m_remoteColumnAtEdge || distance >= absolute) {
+        char buffer[32];
+        winpty_snprintf(buffer, CSI "%uG", absolute);
+        write(buffer);
+    } else if (delta == -1) {
+        // Backspace moves left without erasing.
+        write("\b");
+    } else if (delta == -2) {
+        write("\b\b");
+    } else {
+        // Cursor Forward/Backward (CUF/CUB) is shorter than CHA when the
+        // distance has fewer digits than the column.
+        char buffer[32];
+        winpty_snprintf(buffer, CSI "%u%c", distance, delta < 0 ? 'D' : 'C');
+        write(buffer);
+    }
+
+    // The cells left of the new column are unchanged, so we can keep
+    // appending to the line afterward.  Cells to the right of what we've
+    // output are unknown.
+    if (m_lineDataValid && static_cast<size_t>(column) <= m_lineData.size()) {
+        m_lineData.resize(column);
+    } else {
+        m_lineDataValid = (column == 0);
+        m_lineData.clear();
+    }
+    m_remoteColumn = column;
+    m_remoteColumnAtEdge = false;
+}
+
+// Hide the cursor while a frame moves it around, so the user doesn't see it
+// jump.  With synchronized output, the terminal displays the frame
+// atomically, so there's no need.
+void Terminal::hideCursorDuringFrame()
+{
+    if (!m_syncOutputSupported) {
+        hideTerminalCursor();
     }
 }
 
@@ -456,7 +711,7 @@ void Terminal::hideTerminalCursor()
         if (m_cursorHidden) {
             return;
         }
-        m_output.write(CSI "?25l");
+        write(CSI "?25l");
         m_cursorHidden = true;
     }
 }
@@ -472,12 +727,10 @@ void Terminal::moveTerminalToLine(int64_t line)
     // 2.32.0 does handle it.  Cursor Next Line (CNL) does nothing if the
     // cursor is on the last line already.
 
-    hideTerminalCursor();
-
     if (line < m_remoteLine) {
         if (m_plainMode) {
             // We can't backtrack, so instead repeat the lines again.
-            m_output.write("\r\n");
+            write("\r\n");
             m_remoteLine = line;
         } else {
             // Backtrack and overwrite previous lines.
@@ -485,12 +738,12 @@ void Terminal::moveTerminalToLine(int64_t line)
             char buffer[32];
             winpty_snprintf(buffer, "\r" CSI "%uA",
                 static_cast<unsigned int>(m_remoteLine - line));
-            m_output.write(buffer);
+            write(buffer);
             m_remoteLine = line;
         }
     } else if (line > m_remoteLine) {
         while (line > m_remoteLine) {
-            m_output.write("\r\n");
+            write("\r\n");
             m_remoteLine++;
         }
     }
@@ -498,38 +751,85 @@ void Terminal::moveTerminalToLine(int64_t line)
     m_lineDataValid = true;
     m_lineData.clear();
     m_remoteColumn = 0;
+    m_remoteColumnAtEdge = false;
 }
 
-void Terminal::enableMouseMode(bool enabled)
+void Terminal::setMouseTracking(MouseTracking tracking)
 {
-    if (m_mouseModeEnabled == enabled || m_plainMode) {
+    if (m_mouseTracking == tracking || m_plainMode) {
         return;
     }
-    m_mouseModeEnabled = enabled;
-    if (enabled) {
+    const MouseTracking prev = m_mouseTracking;
+    m_mouseTracking = tracking;
+    if (prev == MouseTracking::Off) {
         // Start by disabling UTF-8 coordinate mode (1005), just in case we
         // have a terminal that does not support 1006/1015 modes, and 1005
         // happens to be enabled.  The UTF-8 coordinates can't be unambiguously
         // decoded.
         //
         // Enable basic mouse support first (1000), then try to switch to
-        // button-move mode (1002), then try full mouse-move mode (1003).
-        // Terminals that don't support a mode will be stuck at the highest
-        // mode they do support.
+        // button-move mode (1002), and, if requested, full mouse-move mode
+        // (1003).  Terminals that don't support a mode will be stuck at the
+        // highest mode they do support.
         //
         // Enable encoding mode 1015 first, then try to switch to 1006.  On
         // some terminals, both modes will be enabled, but 1006 will have
         // priority.  On other terminals, 1006 wins because it's listed last.
         //
         // See misc/MouseInputNotes.txt for details.
-        m_output.write(
-            CSI "?1005l"
-            CSI "?1000h" CSI "?1002h" CSI "?1003h" CSI "?1015h" CSI "?1006h");
+        write(CSI "?1005l" CSI "?1000h" CSI "?1002h");
+        if (tracking == MouseTracking::AnyMotion) {
+            write(CSI "?1003h");
+        }
+        write(CSI "?1015h" CSI "?1006h");
+    } else if (tracking == MouseTracking::AnyMotion) {
+        write(CSI "?1003h");
+    } else if (tracking == MouseTracking::ButtonMotion) {
+        // In xterm, resetting any of the 100[023] modes turns tracking off,
+        // so enable button-move mode again.
+        write(CSI "?1003l" CSI "?1000h" CSI "?1002h");
     } else {
         // Resetting both encoding modes (1006 and 1015) is necessary, but
         // apparently we only need to use reset on one of the 100[023] modes.
         // Doing both doesn't hurt.
-        m_output.write(
+        write(
             CSI "?1006l" CSI "?1015l" CSI "?1003l" CSI "?1002l" CSI "?1000l");
     }
 }
+
+// Write a "Device Status Report" command to the terminal.  The terminal will
+// reply with a row+col escape sequence.
+void Terminal::sendDsr()
+{
+    if (!m_plainMode) {
+        write(CSI "6n");
+    }
+}
+
+// Ask whether the terminal supports synchronized output (DEC private mode
+// 2026) using DECRQM.  ConsoleInput recognizes the DECRPM reply.  Terminals
+// that don't know the mode reply that it isn't recognized or don't reply.
+void Terminal::sendSyncOutputQuery()
+{
+    if (!m_plainMode) {
+        write(CSI "?2026$p");
+    }
+}
+
+void Terminal::sendTitle(const std::wstring &title)
+{
+    if (!m_utf16Output) {
+        const std::string command =
+            std::string("\x1b]0;") + utf8FromWide(title) + "\x07";
+        m_output.write(command.c_str());
+    } else {
+        std::string &buf = m_termWriteWorkingBuffer;
+        buf.assign("\x1b]0;");
+        widenAsciiToUtf16(buf, 0);
+        for (wchar_t ch : title) {
+            appendUtf16(buf, ch);
+        }
+        appendUtf16(buf, L'\x07');
+        m_output.write(buf.data(), buf.size());
+    }
+}
@@ -29,41 +29,64 @@
 
 #include "Coord.h"
 
+class EncodedLineCache;
 class NamedPipe;
 
 class Terminal
 {
 public:
-    explicit Terminal(NamedPipe &output, bool plainMode, bool outputColor)
-        : m_output(output), m_plainMode(plainMode), m_outputColor(outputColor)
-    {
-    }
+    explicit Terminal(NamedPipe &output, bool plainMode, bool outputColor,
+                      bool utf16Output, EncodedLineCache *lineCache=nullptr);
 
     enum SendClearFlag { OmitClear, SendClear };
     void reset(SendClearFlag sendClearFirst, int64_t newLine);
+    void beginFrame();
     void sendLine(int64_t line, const CHAR_INFO *lineData, int width,
                   int cursorColumn);
-    void showTerminalCursor(int column, int64_t line);
-    void hideTerminalCursor();
+    enum EraseDirection { EraseBelow, EraseAbove };
+    bool canEraseScreen() const { return !m_plainMode; }
+    WORD outputAttributesMask() const { return m_outputAttributesMask; }
+    void eraseScreen(EraseDirection direction, int64_t line, WORD attributes);
+    void endFrame(bool showCursor, int column, int64_t line);
+    void sendDsr();
+    void sendSyncOutputQuery();
+    void setSyncOutputSupported(bool supported);
+    void sendTitle(const std::wstring &title);
 
 private:
+    void write(const char *text);
+    void writeRaw(const char *data, size_t size);
+    void openSyncUpdate();
+    void hideTerminalCursor();
+    void hideCursorDuringFrame();
     void moveTerminalToLine(int64_t line);
+    void moveTerminalToColumn(int column);
 
 public:
-    void enableMouseMode(bool enabled);
+    // Off, button-motion tracking (1002), or any-motion tracking (1003).
+    enum class MouseTracking { Off, ButtonMotion, AnyMotion };
+    void setMouseTracking(MouseTracking tracking);
 
 private:
     NamedPipe &m_output;
+    EncodedLineCache *m_lineCache = nullptr;
+    WORD m_outputAttributesMask = 0;
     int64_t m_remoteLine = 0;
     int m_remoteColumn = 0;
+    bool m_remoteColumnAtEdge = false;
     bool m_lineDataValid = true;
     std::vector<CHAR_INFO> m_lineData;
     bool m_cursorHidden = false;
     int m_remoteColor = -1;
     std::string m_termLineWorkingBuffer;
+    std::string m_termWriteWorkingBuffer;
     bool m_plainMode = false;
     bool m_outputColor = true;
-    bool m_mouseModeEnabled = false;
+    bool m_utf16Output = false;
+    MouseTracking m_mouseTracking = MouseTracking::Off;
+    bool m_inFrame = false;
+    bool m_syncOutputSupported = false;
+    bool m_syncUpdateOpen = false;
 };
 
 #endif // TERMINAL_H
@@ -0,0 +1,133 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for Terminal's output framing.  NamedPipe is replaced with
+// an in-memory version below, so it only needs a minimal <windows.h>, e.g.:
+//     g++ -std=c++11 -I../tests/common TerminalTest.cc Terminal.cc
+//         EncodedLineCache.cc
+
+#include "Terminal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "NamedPipe.h"
+
+#include "../tests/common/TestCheck.h"
+
+void assertTrace(const char *file, int line, const char *cond) {
+    fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, cond);
+}
+void trace(const char *format, ...) {}
+
+// Only titles use it, and the test doesn't send any.
+std::string utf8FromWide(const std::wstring &input) { abort(); }
+
+// NamedPipe's event loop is its only friend, so stand in for it to create a
+// pipe and read back what the Terminal queued.
+class EventLoop {
+public:
+    static NamedPipe *createPipe() { return new NamedPipe; }
+    static void destroyPipe(NamedPipe *pipe) { delete pipe; }
+    static std::string takeOutput(NamedPipe &pipe) {
+        std::string ret;
+        ret.swap(pipe.m_outQueue);
+        return ret;
+    }
+};
+
+void NamedPipe::write(const void *data, size_t size) {
+    m_outQueue.append(static_cast<const char*>(data), size);
+}
+void NamedPipe::write(const char *text) { write(text, strlen(text)); }
+void NamedPipe::closePipe() {}
+void OwnedHandle::dispose(bool nothrow) {}
+
+namespace {
+
+std::vector<CHAR_INFO> makeLine(const char *text, int width) {
+    std::vector<CHAR_INFO> ret(width);
+    for (int i = 0; i < width; ++i) {
+        ret[i].Char.UnicodeChar = *text != '\0' ? *text++ : ' ';
+        ret[i].Attributes = 7;
+    }
+    return ret;
+}
+
+std::string widen(const std::string &text) {
+    std::string ret;
+    for (char ch : text) {
+        ret.push_back(ch);
+        ret.push_back('\0');
+    }
+    return ret;
+}
+
+// Sends a few frames and returns the output.
+std::string sendFrames(bool utf16Output, bool syncOutput) {
+    NamedPipe *pipe = EventLoop::createPipe();
+    std::string ret;
+    {
+        Terminal term(*pipe, false, true, utf16Output);
+        term.setSyncOutputSupported(syncOutput);
+        const int width = 10;
+        for (int frame = 0; frame < 3; ++frame) {
+            term.beginFrame();
+            for (int line = 0; line < 3; ++line) {
+                const auto data = makeLine(
+                    frame == 0 ? "hello" : (line == frame ? "changed" : "x"),
+                    width);
+                term.sendLine(line, data.data(), width, -1);
+            }
+            term.endFrame(true, 2, frame);
+        }
+        ret = EventLoop::takeOutput(*pipe);
+    }
+    EventLoop::destroyPipe(pipe);
+    return ret;
+}
+
+void testSyncOutputFraming() {
+    const std::string out = sendFrames(false, true);
+    CHECK(out.compare(0, 8, "\x1b[?2026h") == 0);
+    CHECK(out.compare(out.size() - 8, 8, "\x1b[?2026l") == 0);
+    CHECK(out != sendFrames(false, false));
+}
+
+// The UTF-16 output is the UTF-8 output, widened.  The synchronized update
+// opener used to share a buffer with the escape sequence that triggered it,
+// which garbled the frame's first sequence.
+void testUtf16Output() {
+    CHECK(sendFrames(true, false) == widen(sendFrames(false, false)));
+    CHECK(sendFrames(true, true) == widen(sendFrames(false, true)));
+}
+
+} // anonymous namespace
+
+int main() {
+    testSyncOutputFraming();
+    testUtf16Output();
+    printf("All tests passed.\n");
+    return 0;
+}
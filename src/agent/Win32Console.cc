@@ -99,9 +99,13 @@ void Win32Console::setFrozen(bool frozen) {
                                              : SC_CONSOLE_SELECT_ALL;
         SendMessage(m_hwnd, WM_SYSCOMMAND, command, 0);
         m_frozen = true;
+        m_freezeCount++;
+        m_freezeTimer = TimeMeasurement();
     } else {
         // Send Escape to cancel the selection.
         SendMessage(m_hwnd, WM_CHAR, 27, 0x00010001);
         m_frozen = false;
+        m_freezeUsec +=
+            static_cast<uint64_t>(m_freezeTimer.elapsed() * 1000000.0);
     }
 }
@@ -22,10 +22,13 @@
 #define AGENT_WIN32_CONSOLE_H
 
 #include <windows.h>
+#include <stdint.h>
 
 #include <string>
 #include <vector>
 
+#include "../shared/TimeMeasurement.h"
+
 class Win32Console
 {
 public:
@@ -55,11 +58,16 @@ public:
     bool isNewW10() { return m_isNewW10; }
     void setFrozen(bool frozen=true);
     bool frozen() { return m_frozen; }
+    uint64_t freezeCount() { return m_freezeCount; }
+    uint64_t freezeUsec() { return m_freezeUsec; }
 
 private:
     HWND m_hwnd = nullptr;
     bool m_frozen = false;
     bool m_freezeUsesMark = false;
+    uint64_t m_freezeCount = 0;
+    uint64_t m_freezeUsec = 0;
+    TimeMeasurement m_freezeTimer;
     bool m_isNewW10 = false;
     std::vector<wchar_t> m_titleWorkBuf;
 };
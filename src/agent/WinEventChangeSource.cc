@@ -0,0 +1,134 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "WinEventChangeSource.h"
+
+#include "../shared/WinptyAssert.h"
+#include "../shared/DebugClient.h"
+
+WinEventChangeSource *WinEventChangeSource::s_instance = nullptr;
+
+std::unique_ptr<WinEventChangeSource>
+WinEventChangeSource::create(HWND consoleWindow)
+{
+    if (consoleWindow == nullptr) {
+        return nullptr;
+    }
+    std::unique_ptr<WinEventChangeSource> ret(
+        new WinEventChangeSource(consoleWindow));
+    if (ret->m_thread.get() == nullptr) {
+        return nullptr;
+    }
+    WaitForSingleObject(ret->m_readyEvent.get(), INFINITE);
+    if (!ret->m_hooked) {
+        trace("WinEventChangeSource: SetWinEventHook failed");
+        return nullptr;
+    }
+    return ret;
+}
+
+WinEventChangeSource::WinEventChangeSource(HWND consoleWindow) :
+    m_consoleWindow(consoleWindow),
+    m_changeEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr)),
+    m_readyEvent(CreateEventW(nullptr, TRUE, FALSE, nullptr))
+{
+    ASSERT(m_changeEvent.get() != nullptr && m_readyEvent.get() != nullptr);
+    ASSERT(s_instance == nullptr);
+    s_instance = this;
+    HANDLE thread = CreateThread(nullptr, 0, threadProc, this, 0, &m_threadId);
+    if (thread == nullptr) {
+        trace("WinEventChangeSource: CreateThread failed: %u",
+            static_cast<unsigned>(GetLastError()));
+        return;
+    }
+    m_thread = OwnedHandle(thread);
+}
+
+WinEventChangeSource::~WinEventChangeSource()
+{
+    if (m_thread.get() != nullptr) {
+        // The thread created its message queue before signaling the ready
+        // event, so the quit message can't be lost.  If the hook failed, the
+        // thread has already returned.
+        WaitForSingleObject(m_readyEvent.get(), INFINITE);
+        if (m_hooked && !PostThreadMessageW(m_threadId, WM_QUIT, 0, 0)) {
+            trace("WinEventChangeSource: PostThreadMessage failed: %u",
+                static_cast<unsigned>(GetLastError()));
+        } else {
+            WaitForSingleObject(m_thread.get(), INFINITE);
+        }
+    }
+    s_instance = nullptr;
+}
+
+void WinEventChangeSource::takeChanges(ConsoleChanges &out)
+{
+    // The hook records a change before it signals the event, so resetting
+    // the event first can't lose a change.  At worst, the event is signaled
+    // with nothing left to take.
+    LockGuard<Mutex> lock(m_mutex);
+    ResetEvent(m_changeEvent.get());
+    m_recorder.take(out);
+}
+
+DWORD WINAPI WinEventChangeSource::threadProc(LPVOID param)
+{
+    static_cast<WinEventChangeSource*>(param)->run();
+    return 0;
+}
+
+void WinEventChangeSource::run()
+{
+    // Create the thread's message queue.
+    MSG msg;
+    PeekMessageW(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+
+    DWORD conhostPid = 0;
+    GetWindowThreadProcessId(m_consoleWindow, &conhostPid);
+    const HWINEVENTHOOK hook = SetWinEventHook(
+        EVENT_CONSOLE_CARET, EVENT_CONSOLE_LAYOUT, nullptr, winEventProc,
+        conhostPid, 0, WINEVENT_OUTOFCONTEXT);
+    m_hooked = hook != nullptr;
+    SetEvent(m_readyEvent.get());
+    if (hook == nullptr) {
+        return;
+    }
+
+    while (GetMessageW(&msg, nullptr, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
+    }
+    UnhookWinEvent(hook);
+}
+
+void CALLBACK WinEventChangeSource::winEventProc(
+        HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+        LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTime)
+{
+    WinEventChangeSource *const self = s_instance;
+    if (self == nullptr || hwnd != self->m_consoleWindow) {
+        return;
+    }
+    {
+        LockGuard<Mutex> lock(self->m_mutex);
+        self->m_recorder.record(event, idObject, idChild);
+    }
+    SetEvent(self->m_changeEvent.get());
+}
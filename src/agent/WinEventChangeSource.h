@@ -0,0 +1,67 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_WIN_EVENT_CHANGE_SOURCE_H
+#define AGENT_WIN_EVENT_CHANGE_SOURCE_H
+
+#include <windows.h>
+
+#include <memory>
+
+#include "ConsoleChangeSource.h"
+
+#include "../shared/Mutex.h"
+#include "../shared/OwnedHandle.h"
+
+// Listens for the EVENT_CONSOLE_xxx WinEvents that conhost raises for its
+// window.  Out-of-context WinEvents are delivered through a message queue, so
+// the hook lives on its own thread, which pumps messages and signals the
+// change event.
+class WinEventChangeSource : public ConsoleChangeSource {
+public:
+    // Returns nullptr if the hook can't be installed.
+    static std::unique_ptr<WinEventChangeSource> create(HWND consoleWindow);
+    virtual ~WinEventChangeSource();
+    HANDLE changeEvent() override { return m_changeEvent.get(); }
+    void takeChanges(ConsoleChanges &out) override;
+
+private:
+    WinEventChangeSource(HWND consoleWindow);
+    static DWORD WINAPI threadProc(LPVOID param);
+    void run();
+    static void CALLBACK winEventProc(HWINEVENTHOOK hook, DWORD event,
+                                      HWND hwnd, LONG idObject, LONG idChild,
+                                      DWORD eventThread, DWORD eventTime);
+
+    const HWND m_consoleWindow;
+    OwnedHandle m_changeEvent;
+    OwnedHandle m_readyEvent;
+    OwnedHandle m_thread;
+    DWORD m_threadId = 0;
+    bool m_hooked = false;
+    Mutex m_mutex;
+    ConsoleEventRecorder m_recorder;
+
+    // The hook procedure has no context parameter.  The agent only has one
+    // console.
+    static WinEventChangeSource *s_instance;
+};
+
+#endif // AGENT_WIN_EVENT_CHANGE_SOURCE_H
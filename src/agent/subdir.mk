@@ -25,26 +25,34 @@ $(eval $(call def_mingw_target,agent,-DWINPTY_AGENT_ASSERT))
 AGENT_OBJECTS = \
 	build/agent/agent/Agent.o \
 	build/agent/agent/AgentCreateDesktop.o \
+	build/agent/agent/ConsoleChangeSource.o \
 	build/agent/agent/ConsoleFont.o \
 	build/agent/agent/ConsoleInput.o \
 	build/agent/agent/ConsoleInputReencoding.o \
 	build/agent/agent/ConsoleLine.o \
 	build/agent/agent/DebugShowInput.o \
 	build/agent/agent/DefaultInputMap.o \
+	build/agent/agent/EncodedLineCache.o \
 	build/agent/agent/EventLoop.o \
+	build/agent/agent/HistoryStore.o \
 	build/agent/agent/InputMap.o \
 	build/agent/agent/LargeConsoleRead.o \
+	build/agent/agent/MouseMotionDetector.o \
 	build/agent/agent/NamedPipe.o \
+	build/agent/agent/ResizePlanner.o \
+	build/agent/agent/ScrapeScheduler.o \
 	build/agent/agent/Scraper.o \
 	build/agent/agent/Terminal.o \
 	build/agent/agent/Win32Console.o \
 	build/agent/agent/Win32ConsoleBuffer.o \
+	build/agent/agent/WinEventChangeSource.o \
 	build/agent/agent/main.o \
 	build/agent/shared/BackgroundDesktop.o \
 	build/agent/shared/Buffer.o \
 	build/agent/shared/DebugClient.o \
 	build/agent/shared/GenRandom.o \
 	build/agent/shared/OwnedHandle.o \
+	build/agent/shared/StatsPage.o \
 	build/agent/shared/StringUtil.o \
 	build/agent/shared/WindowsSecurity.o \
 	build/agent/shared/WindowsVersion.o \
@@ -106,6 +106,13 @@ winpty_config_set_mouse_mode(winpty_config_t *cfg, int mouseMode);
 WINPTY_API void
 winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs);
 
+/* Limit the CPU time the agent spends scraping the console and encoding
+ * terminal output, as a percentage of one CPU (1-100).  Over its budget, the
+ * agent scrapes less often, so output arrives in fewer, larger updates.  Zero
+ * (the default) means no limit.  See also winpty_set_cpu_budget. */
+WINPTY_API void
+winpty_config_set_cpu_budget(winpty_config_t *cfg, int percent);
+
 
 
 /*****************************************************************************
@@ -146,6 +153,60 @@ WINPTY_API LPCWSTR winpty_conerr_name(winpty_t *wp);
 
 
 
+/*****************************************************************************
+ * Shared I/O engine. */
+
+/* Instead of opening the pipes above and reading them with threads of its
+ * own, a client can attach a winpty_t to libwinpty's I/O engine.  One engine
+ * thread services the data pipes of every attached winpty_t in the process
+ * using a single I/O completion port, so the number of threads does not grow
+ * with the number of sessions.  A winpty_t is attached at most once, and its
+ * data pipes must not be opened by the client as well.
+ *
+ * stream is WINPTY_STREAM_CONOUT or WINPTY_STREAM_CONERR.  The CONERR stream
+ * exists only with WINPTY_FLAG_CONERR. */
+
+/* Called on the engine thread with each chunk of output.  A NULL data pointer
+ * and zero size mean the stream has ended.  The next chunk of the same stream
+ * is not read until the callback returns, so a slow callback delays that
+ * stream and, because the engine has only one thread, every other session.
+ * The callback may call winpty_io_write, but it must not free any winpty_t
+ * object. */
+typedef void (*winpty_io_callback_t)(void *context, winpty_t *wp, int stream,
+                                     const void *data, DWORD size);
+
+/* Attaches the winpty_t to the I/O engine.  If callback is NULL, output is
+ * queued instead and retrieved with winpty_io_read.  The winpty_t is
+ * detached by winpty_free. */
+WINPTY_API BOOL
+winpty_io_attach(winpty_t *wp,
+                 winpty_io_callback_t callback /*OPTIONAL*/,
+                 void *context /*OPTIONAL*/,
+                 winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Queues input for CONIN and returns without waiting for it to be written.
+ * Fails with WINPTY_ERROR_LOST_CONNECTION once a write to the agent has
+ * failed. */
+WINPTY_API BOOL
+winpty_io_write(winpty_t *wp, const void *data, DWORD size,
+                winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* For a winpty_t attached without a callback, copies up to size bytes of
+ * queued output into data and stores the count in *actual, which is zero if
+ * nothing is queued.  It never blocks.  Once the stream has ended and its
+ * queue is empty, it fails with WINPTY_ERROR_LOST_CONNECTION.  A stream whose
+ * queue is full is not read again until the client reads from it. */
+WINPTY_API BOOL
+winpty_io_read(winpty_t *wp, int stream, void *data, DWORD size,
+               DWORD *actual, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Returns a manual-reset event that is signaled while winpty_io_read has
+ * output or an end-of-stream to report for some stream.  The handle is owned
+ * by the winpty_t.  Returns NULL if the winpty_t is not attached. */
+WINPTY_API HANDLE winpty_io_event(winpty_t *wp);
+
+
+
 /*****************************************************************************
  * winpty agent RPC call: process creation. */
 
@@ -192,9 +253,16 @@ WINPTY_API void winpty_spawn_config_free(winpty_spawn_config_t *cfg);
  * to GetLastError(), and the WINPTY_ERROR_SPAWN_CREATE_PROCESS_FAILED error
  * is returned.
  *
- * winpty_spawn can only be called once per winpty_t object.  If it is called
- * before the output data pipe(s) is/are connected, then collected output is
- * buffered until the pipes are connected, rather than being discarded.
+ * winpty_spawn can only be called once per winpty_t object, unless the agent
+ * was configured with WINPTY_FLAG_SEQUENTIAL_SPAWN.  In that case, it can be
+ * called again after the previous child process exits; while that process
+ * is still running, the WINPTY_ERROR_SPAWN_CHILD_RUNNING error is returned.
+ * Once a child spawned with WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN exits, the agent
+ * closes its data pipes, and later calls fail with
+ * WINPTY_ERROR_SPAWN_AGENT_SHUT_DOWN.
+ * If it is called before the output data pipe(s) is/are connected, then
+ * collected output is buffered until the pipes are connected, rather than
+ * being discarded.
  *
  * N.B.: GetProcessId works even if the process has exited.  The PID is not
  * recycled until the NT process object is freed.
@@ -210,6 +278,54 @@ winpty_spawn(winpty_t *wp,
 
 
 
+/*****************************************************************************
+ * winpty agent RPC call: history paging. */
+
+/* The agent keeps the lines that scroll out of the console window, up to a
+ * memory limit, so that a client can fetch old output as the user scrolls
+ * back instead of buffering the whole stream itself.  History lines are
+ * numbered from zero in the order they left the window.  Each line is UTF-16
+ * text plus runs of console attributes (FOREGROUND_xxx / BACKGROUND_xxx
+ * values) covering the text.  Trailing blanks in the default color are
+ * omitted, so a line may be shorter than the terminal. */
+
+typedef struct winpty_history_s winpty_history_t;
+
+typedef struct winpty_attr_run_s {
+    DWORD length;
+    WORD attributes;
+} winpty_attr_run_t;
+
+/* Fetches up to line_count lines starting at first_line from the given
+ * stream (WINPTY_STREAM_CONOUT or WINPTY_STREAM_CONERR).  The result may
+ * start later and hold fewer lines than requested: lines the agent has
+ * discarded or not yet captured are skipped, and a single call returns at
+ * most 1000 lines.  Returns NULL on error. */
+WINPTY_API winpty_history_t *
+winpty_read_history(winpty_t *wp, int stream, INT64 first_line,
+                    int line_count, winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* The oldest line the agent still has, and one past the newest line, at the
+ * time of the call. */
+WINPTY_API INT64 winpty_history_oldest_line(winpty_history_t *history);
+WINPTY_API INT64 winpty_history_end_line(winpty_history_t *history);
+
+/* The lines in this result are first_line through
+ * first_line + line_count - 1.  index is relative to first_line. */
+WINPTY_API INT64 winpty_history_first_line(winpty_history_t *history);
+WINPTY_API int winpty_history_line_count(winpty_history_t *history);
+WINPTY_API LPCWSTR winpty_history_line_text(winpty_history_t *history,
+                                            int index,
+                                            DWORD *length /*OPTIONAL*/);
+WINPTY_API const winpty_attr_run_t *
+winpty_history_line_runs(winpty_history_t *history, int index,
+                         DWORD *run_count);
+
+/* Frees the result.  The strings and runs returned above become invalid. */
+WINPTY_API void winpty_history_free(winpty_history_t *history);
+
+
+
 /*****************************************************************************
  * winpty agent RPC calls: everything else */
 
@@ -218,6 +334,39 @@ WINPTY_API BOOL
 winpty_set_size(winpty_t *wp, int cols, int rows,
                 winpty_error_ptr_t *err /*OPTIONAL*/);
 
+/* Tell the agent whether the terminal is currently visible.  visibility is
+ * one of the WINPTY_VISIBILITY_xxx constants.  While the terminal is hidden or
+ * minimized, the agent reduces its polling rate.  When it becomes visible
+ * again, the agent immediately sends a single update bringing the terminal
+ * up-to-date. */
+WINPTY_API BOOL
+winpty_set_visibility(winpty_t *wp, int visibility,
+                      winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Tell the agent which rows of the terminal the client is displaying, for
+ * clients that show only part of a tall terminal.  first_row is zero-based
+ * and relative to the top of the terminal.  The agent refreshes those rows
+ * (and the cursor's row) at its full rate and the remaining rows less often.
+ * A row_count of zero removes the hint, so that every row is refreshed at the
+ * full rate again.  The hint only affects full-screen (alternate screen)
+ * programs; output that scrolls is always refreshed completely. */
+WINPTY_API BOOL
+winpty_set_viewport(winpty_t *wp, int first_row, int row_count,
+                    winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Change the agent's CPU budget.  See winpty_config_set_cpu_budget. */
+WINPTY_API BOOL
+winpty_set_cpu_budget(winpty_t *wp, int percent,
+                      winpty_error_ptr_t *err /*OPTIONAL*/);
+
+/* Grant the agent more frame credits.  Only meaningful with
+ * WINPTY_FLAG_FRAME_CREDITS.  Credits accumulate, so a client can grant one
+ * per frame it renders, or several to allow some output to queue up.  A
+ * credit count that isn't positive is ignored. */
+WINPTY_API BOOL
+winpty_grant_frame_credits(winpty_t *wp, int credits,
+                           winpty_error_ptr_t *err /*OPTIONAL*/);
+
 /* Gets a list of processes attached to the console. */
 WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
@@ -228,7 +377,9 @@ winpty_get_console_process_list(winpty_t *wp, int *processList, const int proces
  * console, terminating the processes attached to it.
  *
  * This function must not be called if any other threads are using the
- * winpty_t object.  Undefined behavior results. */
+ * winpty_t object.  Undefined behavior results.  If the winpty_t is attached
+ * to the I/O engine, it is detached first; this waits for a running callback
+ * to return, so it must not be called from an I/O callback. */
 WINPTY_API void winpty_free(winpty_t *wp);
 
 
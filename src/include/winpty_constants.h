@@ -42,6 +42,8 @@
 #define WINPTY_ERROR_AGENT_DIED                     6
 #define WINPTY_ERROR_AGENT_TIMEOUT                  7
 #define WINPTY_ERROR_AGENT_CREATION_FAILED          8
+#define WINPTY_ERROR_SPAWN_CHILD_RUNNING            9
+#define WINPTY_ERROR_SPAWN_AGENT_SHUT_DOWN          10
 
 
 
@@ -76,11 +78,48 @@
  * See https://github.com/rprichard/winpty/issues/58. */
 #define WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION 0x8ull
 
+/* Encode the CONOUT and CONERR streams as UTF-16LE instead of UTF-8.  This
+ * mode suits Windows-native clients, which would otherwise convert the UTF-8
+ * stream back to UTF-16.  Escape sequences are encoded as UTF-16 too.  The
+ * CONIN stream is still UTF-8. */
+#define WINPTY_FLAG_UTF16_OUTPUT        0x10ull
+
+/* Allow winpty_spawn to be called again once the previous child process has
+ * exited, so one agent can run a series of short commands.  Before starting
+ * the next child, the agent sends the previous child's remaining output,
+ * then blanks the console, discards pending input, and resets the console
+ * title and input mode.  The terminal keeps the previous output, and the next
+ * child's output starts on a new line (unless the previous child used a
+ * full-screen buffer, in which case the terminal is cleared).  Don't combine
+ * this flag with WINPTY_SPAWN_FLAG_AUTO_SHUTDOWN except for the last child,
+ * because the agent closes its output pipes when that child exits. */
+#define WINPTY_FLAG_SEQUENTIAL_SPAWN    0x20ull
+
+/* Let the client pace the output.  The agent only scrapes the console and
+ * sends an update while it holds frame credits, which the client grants with
+ * winpty_grant_frame_credits (e.g. one per rendered frame).  Each update
+ * spends one credit and brings the terminal up to the console's latest state.
+ * The agent starts with no credits.  Lines about to scroll out of the
+ * console's scrollback are still sent, in order, without waiting for a
+ * credit, as is the final output of an auto-shutdown child. */
+#define WINPTY_FLAG_FRAME_CREDITS       0x40ull
+
+/* Always ask the terminal to report every mouse movement (any-motion
+ * tracking, mode 1003) while terminal mouse mode is on.  By default, the
+ * agent only asks for motion while a button is held (mode 1002), and
+ * switches to any-motion tracking once the console app is seen reacting to
+ * mouse motion. */
+#define WINPTY_FLAG_MOUSE_ANY_MOTION    0x80ull
+
 #define WINPTY_FLAG_MASK (0ull \
     | WINPTY_FLAG_CONERR \
     | WINPTY_FLAG_PLAIN_OUTPUT \
     | WINPTY_FLAG_COLOR_ESCAPES \
     | WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION \
+    | WINPTY_FLAG_UTF16_OUTPUT \
+    | WINPTY_FLAG_SEQUENTIAL_SPAWN \
+    | WINPTY_FLAG_FRAME_CREDITS \
+    | WINPTY_FLAG_MOUSE_ANY_MOTION \
 )
 
 /* QuickEdit mode is initially disabled, and the agent does not send mouse
@@ -128,4 +167,31 @@
 
 
 
+/*****************************************************************************
+ * winpty agent RPC call: visibility hint. */
+
+/* The terminal is on-screen.  The agent scrapes the console at its full rate.
+ * This is the initial state. */
+#define WINPTY_VISIBILITY_VISIBLE       0
+
+/* The terminal is open but not currently shown (e.g. a background tab).  The
+ * agent scrapes the console less often, so output is coalesced into fewer,
+ * larger updates.  Lines that scroll into the console's scrollback are still
+ * captured and sent. */
+#define WINPTY_VISIBILITY_HIDDEN        1
+
+/* The terminal's window is minimized.  Like WINPTY_VISIBILITY_HIDDEN, but
+ * the agent scrapes even less often. */
+#define WINPTY_VISIBILITY_MINIMIZED     2
+
+
+
+/*****************************************************************************
+ * Shared I/O engine: output streams. */
+
+#define WINPTY_STREAM_CONOUT            1
+#define WINPTY_STREAM_CONERR            2
+
+
+
 #endif /* WINPTY_CONSTANTS_H */
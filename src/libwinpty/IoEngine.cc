@@ -0,0 +1,434 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "IoEngine.h"
+
+#include <windows.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "../shared/DebugClient.h"
+#include "../shared/WinptyAssert.h"
+#include "../shared/WinptyException.h"
+
+#include "LibWinptyException.h"
+
+namespace {
+
+// Completion keys.  Pipe handles are associated with kPipeKey.  The other two
+// are only ever posted by hand.
+const ULONG_PTR kPipeKey = 0;
+const ULONG_PTR kFailedOpKey = 1;
+const ULONG_PTR kQuitKey = 2;
+
+// In queue mode, stop reading a stream once this much output is waiting for
+// the client.  The agent then blocks on the pipe, as it would with a client
+// that reads the pipe itself and falls behind.
+const size_t kMaxQueuedBytes = 64 * 1024;
+
+// Larger writes are split; the remainder is written when each piece completes.
+const size_t kMaxWriteBytes = 64 * 1024;
+
+OwnedHandle createEvent(BOOL initialState) {
+    // manual reset
+    HANDLE h = CreateEventW(nullptr, TRUE, initialState, nullptr);
+    if (h == nullptr) {
+        throwWindowsError(L"CreateEventW failed");
+    }
+    return OwnedHandle(h);
+}
+
+OwnedHandle openDataPipe(const std::wstring &name, DWORD access) {
+    HANDLE h = CreateFileW(name.c_str(), access, 0, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_OVERLAPPED, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        throwWindowsError(L"CreateFileW failed on a data pipe");
+    }
+    return OwnedHandle(h);
+}
+
+int streamIndex(int stream) {
+    ASSERT(stream == WINPTY_STREAM_CONOUT || stream == WINPTY_STREAM_CONERR);
+    return stream - WINPTY_STREAM_CONOUT;
+}
+
+} // anonymous namespace
+
+// The process-wide completion port and its worker thread.  The engine exists
+// while at least one IoSession does.
+class IoEngine {
+public:
+    static IoEngine &acquire();
+    static void release();
+
+    void associate(HANDLE file);
+    void postFailure(OVERLAPPED &over);
+    bool onWorkerThread() const {
+        return GetCurrentThreadId() == m_threadId;
+    }
+
+private:
+    IoEngine();
+    ~IoEngine();
+    static DWORD WINAPI threadProc(LPVOID param);
+    void run();
+
+    OwnedHandle m_port;
+    OwnedHandle m_thread;
+    DWORD m_threadId = 0;
+
+    static Mutex s_mutex;
+    static IoEngine *s_engine;
+    static int s_refCount;
+};
+
+Mutex IoEngine::s_mutex;
+IoEngine *IoEngine::s_engine = nullptr;
+int IoEngine::s_refCount = 0;
+
+IoEngine &IoEngine::acquire() {
+    LockGuard<Mutex> lock(s_mutex);
+    if (s_engine == nullptr) {
+        s_engine = new IoEngine;
+        trace("IoEngine: started");
+    }
+    ++s_refCount;
+    return *s_engine;
+}
+
+void IoEngine::release() {
+    LockGuard<Mutex> lock(s_mutex);
+    ASSERT(s_engine != nullptr && s_refCount > 0);
+    if (--s_refCount == 0) {
+        delete s_engine;
+        s_engine = nullptr;
+        trace("IoEngine: stopped");
+    }
+}
+
+IoEngine::IoEngine() {
+    HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    if (port == nullptr) {
+        throwWindowsError(L"CreateIoCompletionPort failed");
+    }
+    m_port = OwnedHandle(port);
+    HANDLE thread = CreateThread(nullptr, 0, threadProc, this, 0, &m_threadId);
+    if (thread == nullptr) {
+        throwWindowsError(L"CreateThread failed");
+    }
+    m_thread = OwnedHandle(thread);
+}
+
+IoEngine::~IoEngine() {
+    // Every session has detached, so nothing else is queued behind the quit
+    // packet.
+    ASSERT(!onWorkerThread());
+    if (PostQueuedCompletionStatus(m_port.get(), 0, kQuitKey, nullptr)) {
+        WaitForSingleObject(m_thread.get(), INFINITE);
+    } else {
+        trace("IoEngine: PostQueuedCompletionStatus failed: %u",
+            static_cast<unsigned>(GetLastError()));
+    }
+}
+
+void IoEngine::associate(HANDLE file) {
+    if (CreateIoCompletionPort(file, m_port.get(), kPipeKey, 0) == nullptr) {
+        throwWindowsError(L"CreateIoCompletionPort failed on a data pipe");
+    }
+}
+
+void IoEngine::postFailure(OVERLAPPED &over) {
+    const BOOL success =
+        PostQueuedCompletionStatus(m_port.get(), 0, kFailedOpKey, &over);
+    ASSERT(success && "PostQueuedCompletionStatus failed");
+}
+
+DWORD WINAPI IoEngine::threadProc(LPVOID param) {
+    static_cast<IoEngine*>(param)->run();
+    return 0;
+}
+
+void IoEngine::run() {
+    while (true) {
+        DWORD actual = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED *over = nullptr;
+        BOOL success = GetQueuedCompletionStatus(
+            m_port.get(), &actual, &key, &over, INFINITE);
+        DWORD lastError = success ? 0 : GetLastError();
+        if (over == nullptr) {
+            if (key != kQuitKey) {
+                trace("IoEngine: GetQueuedCompletionStatus failed: %u",
+                    static_cast<unsigned>(lastError));
+            }
+            break;
+        }
+        auto &op = *reinterpret_cast<IoSession::IoOp*>(over);
+        if (key == kFailedOpKey) {
+            success = FALSE;
+            lastError = op.postedError;
+            actual = 0;
+        }
+        // The session may be destroyed as soon as onCompletion returns.
+        op.session->onCompletion(op, success, lastError, actual);
+    }
+}
+
+IoSession::IoSession(winpty_t &wp,
+                     winpty_io_callback_t callback,
+                     void *context,
+                     const std::wstring &coninName,
+                     const std::wstring &conoutName,
+                     const std::wstring &conerrName) :
+    m_engine(IoEngine::acquire()),
+    m_wp(wp),
+    m_callback(callback),
+    m_context(context)
+{
+    try {
+        m_idleEvent = createEvent(TRUE);
+        m_readyEvent = createEvent(FALSE);
+        m_conin = openDataPipe(coninName, GENERIC_WRITE);
+        m_engine.associate(m_conin.get());
+        m_writeOp.session = this;
+        m_writeOp.kind = OpKind::Write;
+        const std::wstring *names[kStreamCount] = { &conoutName, &conerrName };
+        for (int i = 0; i < kStreamCount; ++i) {
+            auto &rs = m_read[i];
+            rs.op.session = this;
+            rs.op.kind = OpKind::Read;
+            rs.op.stream = i;
+            if (names[i]->empty()) {
+                rs.eof = true;
+                rs.eofReported = true;
+                continue;
+            }
+            rs.pipe = openDataPipe(*names[i], GENERIC_READ);
+            m_engine.associate(rs.pipe.get());
+        }
+    } catch (...) {
+        IoEngine::release();
+        throw;
+    }
+    LockGuard<Mutex> lock(m_mutex);
+    for (auto &rs : m_read) {
+        if (rs.pipe.get() != nullptr) {
+            startRead(rs);
+        }
+    }
+}
+
+IoSession::~IoSession() {
+    ASSERT(!m_engine.onWorkerThread() &&
+        "a winpty_t cannot be freed from its own I/O callback");
+    {
+        LockGuard<Mutex> lock(m_mutex);
+        m_closing = true;
+        // Closing the pipes cancels the pending reads and write.  Their
+        // completion packets are still queued to the port, so wait for them.
+        for (auto &rs : m_read) {
+            rs.pipe.dispose(true);
+        }
+        m_conin.dispose(true);
+    }
+    WaitForSingleObject(m_idleEvent.get(), INFINITE);
+    {
+        // The worker sets the idle event while holding the mutex.  Acquire it
+        // once more so that the worker is done with this object.
+        LockGuard<Mutex> lock(m_mutex);
+        ASSERT(m_outstanding == 0);
+    }
+    IoEngine::release();
+}
+
+void IoSession::write(const void *data, size_t size) {
+    LockGuard<Mutex> lock(m_mutex);
+    if (m_writeFailed || m_closing) {
+        throw LibWinptyException(WINPTY_ERROR_LOST_CONNECTION,
+            L"lost connection to agent");
+    }
+    m_writeQueue.append(static_cast<const char*>(data), size);
+    if (!m_writePending) {
+        startWrite();
+    }
+}
+
+size_t IoSession::read(int stream, void *data, size_t size) {
+    auto &rs = m_read[streamIndex(stream)];
+    LockGuard<Mutex> lock(m_mutex);
+    ASSERT(m_callback == nullptr &&
+        "winpty_io_read cannot be used with an I/O callback");
+    if (rs.queue.empty() && rs.eof) {
+        rs.eofReported = true;
+        updateReadyEvent();
+        throw LibWinptyException(WINPTY_ERROR_LOST_CONNECTION,
+            L"lost connection to agent");
+    }
+    const size_t amount = std::min(size, rs.queue.size());
+    memcpy(data, rs.queue.data(), amount);
+    rs.queue.erase(0, amount);
+    if (rs.paused && rs.queue.size() < kMaxQueuedBytes && !m_closing) {
+        rs.paused = false;
+        startRead(rs);
+    }
+    updateReadyEvent();
+    return amount;
+}
+
+// Called with the mutex held.
+void IoSession::startRead(ReadStream &rs) {
+    memset(&rs.op.over, 0, sizeof(rs.op.over));
+    opStarted();
+    const BOOL success = ReadFile(rs.pipe.get(), rs.buffer,
+                                  sizeof(rs.buffer), nullptr, &rs.op.over);
+    if (!success && GetLastError() != ERROR_IO_PENDING) {
+        postFailure(rs.op, GetLastError());
+    }
+}
+
+// Called with the mutex held.
+void IoSession::startWrite() {
+    ASSERT(!m_writePending);
+    if (m_writeBuffer.empty()) {
+        if (m_writeQueue.empty()) {
+            return;
+        }
+        m_writeBuffer.swap(m_writeQueue);
+    }
+    m_writePending = true;
+    memset(&m_writeOp.over, 0, sizeof(m_writeOp.over));
+    opStarted();
+    const DWORD amount = static_cast<DWORD>(
+        std::min<size_t>(m_writeBuffer.size(), kMaxWriteBytes));
+    const BOOL success = WriteFile(m_conin.get(), m_writeBuffer.data(),
+                                   amount, nullptr, &m_writeOp.over);
+    if (!success && GetLastError() != ERROR_IO_PENDING) {
+        postFailure(m_writeOp, GetLastError());
+    }
+}
+
+// A ReadFile or WriteFile that fails immediately queues no completion packet.
+// Post one anyway, so that every failure is handled on the worker thread.
+void IoSession::postFailure(IoOp &op, DWORD lastError) {
+    op.postedError = lastError;
+    m_engine.postFailure(op.over);
+}
+
+void IoSession::opStarted() {
+    if (m_outstanding++ == 0) {
+        ResetEvent(m_idleEvent.get());
+    }
+}
+
+void IoSession::opFinished() {
+    ASSERT(m_outstanding > 0);
+    if (--m_outstanding == 0) {
+        SetEvent(m_idleEvent.get());
+    }
+}
+
+// In queue mode, the ready event is set while any stream has output or an EOF
+// the client has not seen yet.
+void IoSession::updateReadyEvent() {
+    bool ready = false;
+    for (const auto &rs : m_read) {
+        if (!rs.queue.empty() || (rs.eof && !rs.eofReported)) {
+            ready = true;
+        }
+    }
+    if (ready) {
+        SetEvent(m_readyEvent.get());
+    } else {
+        ResetEvent(m_readyEvent.get());
+    }
+}
+
+void IoSession::onCompletion(IoOp &op, BOOL success, DWORD lastError,
+                             DWORD actual) {
+    LockGuard<Mutex> lock(m_mutex);
+    if (!success && lastError != ERROR_BROKEN_PIPE &&
+            lastError != ERROR_OPERATION_ABORTED) {
+        trace("IoSession: I/O failed: kind=%d stream=%d error=%u",
+            static_cast<int>(op.kind), op.stream,
+            static_cast<unsigned>(lastError));
+    }
+    if (op.kind == OpKind::Read) {
+        onReadComplete(m_read[op.stream], success, actual);
+    } else {
+        onWriteComplete(success, actual);
+    }
+    // Finish the op last.  Once the count reaches zero, a detaching thread
+    // may destroy the session as soon as the mutex is released.
+    opFinished();
+}
+
+// Called with the mutex held.  The mutex is released while the callback runs.
+void IoSession::onReadComplete(ReadStream &rs, BOOL success, DWORD actual) {
+    const int stream = WINPTY_STREAM_CONOUT + rs.op.stream;
+    if (success && actual > 0) {
+        if (m_callback != nullptr) {
+            if (!m_closing) {
+                m_mutex.unlock();
+                m_callback(m_context, &m_wp, stream, rs.buffer, actual);
+                m_mutex.lock();
+            }
+        } else {
+            rs.queue.append(rs.buffer, actual);
+        }
+        if (m_closing) {
+            // Don't read again.
+        } else if (m_callback == nullptr &&
+                rs.queue.size() >= kMaxQueuedBytes) {
+            rs.paused = true;
+        } else {
+            startRead(rs);
+        }
+    } else {
+        // Either the agent closed the pipe or the read was cancelled by
+        // ~IoSession.
+        rs.eof = true;
+        if (m_callback != nullptr && !m_closing) {
+            m_mutex.unlock();
+            m_callback(m_context, &m_wp, stream, nullptr, 0);
+            m_mutex.lock();
+        }
+    }
+    if (m_callback == nullptr) {
+        updateReadyEvent();
+    }
+}
+
+// Called with the mutex held.
+void IoSession::onWriteComplete(BOOL success, DWORD actual) {
+    m_writePending = false;
+    if (!success) {
+        m_writeFailed = true;
+        m_writeBuffer.clear();
+        m_writeQueue.clear();
+        return;
+    }
+    m_writeBuffer.erase(0, std::min<size_t>(actual, m_writeBuffer.size()));
+    if (!m_closing) {
+        startWrite();
+    }
+}
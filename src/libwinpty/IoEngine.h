@@ -0,0 +1,119 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBWINPTY_IO_ENGINE_H
+#define LIBWINPTY_IO_ENGINE_H
+
+#include <windows.h>
+
+#include <string>
+
+#include "../include/winpty.h"
+
+#include "../shared/Mutex.h"
+#include "../shared/OwnedHandle.h"
+
+class IoEngine;
+
+// The data pipes of one winpty_t, serviced by the process-wide I/O completion
+// engine rather than by threads of the client's own.  Every IoSession in the
+// process shares a single completion port and a single worker thread.
+//
+// With a callback, output is delivered on the worker thread as it arrives,
+// and the next read on that stream is only issued once the callback returns.
+// Without one, output is queued until the client calls read(), and reading
+// pauses while a stream's queue is full.
+class IoSession {
+public:
+    enum { kStreamCount = 2 };
+
+    IoSession(winpty_t &wp,
+              winpty_io_callback_t callback,
+              void *context,
+              const std::wstring &coninName,
+              const std::wstring &conoutName,
+              const std::wstring &conerrName);
+    // Closes the pipes and waits until the worker thread has finished with
+    // this session, including any callback currently running.
+    ~IoSession();
+
+    void write(const void *data, size_t size);
+    size_t read(int stream, void *data, size_t size);
+    HANDLE readyEvent() { return m_readyEvent.get(); }
+
+    IoSession(const IoSession &other) = delete;
+    IoSession &operator=(const IoSession &other) = delete;
+
+private:
+    friend class IoEngine;
+
+    enum class OpKind { Read, Write };
+
+    struct IoOp {
+        // The OVERLAPPED must be the first member; the worker thread recovers
+        // the IoOp from the OVERLAPPED pointer.
+        OVERLAPPED over;
+        IoSession *session = nullptr;
+        OpKind kind = OpKind::Read;
+        int stream = 0;
+        // Set when ReadFile/WriteFile fails immediately and the failure is
+        // posted to the port by hand.
+        DWORD postedError = 0;
+    };
+
+    struct ReadStream {
+        OwnedHandle pipe;
+        IoOp op;
+        char buffer[32 * 1024];
+        std::string queue;
+        bool paused = false;
+        bool eof = false;
+        bool eofReported = false;
+    };
+
+    void startRead(ReadStream &rs);
+    void startWrite();
+    void postFailure(IoOp &op, DWORD lastError);
+    void opStarted();
+    void opFinished();
+    void updateReadyEvent();
+    void onCompletion(IoOp &op, BOOL success, DWORD lastError, DWORD actual);
+    void onReadComplete(ReadStream &rs, BOOL success, DWORD actual);
+    void onWriteComplete(BOOL success, DWORD actual);
+
+    IoEngine &m_engine;
+    winpty_t &m_wp;
+    winpty_io_callback_t m_callback = nullptr;
+    void *m_context = nullptr;
+    Mutex m_mutex;
+    bool m_closing = false;
+    int m_outstanding = 0;
+    OwnedHandle m_idleEvent;
+    OwnedHandle m_readyEvent;
+    ReadStream m_read[kStreamCount];
+    OwnedHandle m_conin;
+    IoOp m_writeOp;
+    std::string m_writeQueue;
+    std::string m_writeBuffer;
+    bool m_writePending = false;
+    bool m_writeFailed = false;
+};
+
+#endif // LIBWINPTY_IO_ENGINE_H
@@ -23,12 +23,15 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "../include/winpty.h"
 
 #include "../shared/Mutex.h"
 #include "../shared/OwnedHandle.h"
 
+#include "IoEngine.h"
+
 // The structures in this header are not intended to be accessed directly by
 // client programs.
 
@@ -47,6 +50,7 @@ struct winpty_config_s {
     int rows = 25;
     int mouseMode = WINPTY_MOUSE_MODE_AUTO;
     DWORD timeoutMs = 30000;
+    int cpuBudget = 0;
 };
 
 struct winpty_s {
@@ -59,6 +63,16 @@ struct winpty_s {
     std::wstring coninPipeName;
     std::wstring conoutPipeName;
     std::wstring conerrPipeName;
+    // Declared last so that it detaches before the rest is torn down.
+    std::unique_ptr<IoSession> ioSession;
+};
+
+struct winpty_history_s {
+    int64_t oldestLine = 0;
+    int64_t endLine = 0;
+    int64_t firstLine = 0;
+    std::vector<std::wstring> text;
+    std::vector<std::vector<winpty_attr_run_t>> runs;
 };
 
 struct winpty_spawn_config_s {
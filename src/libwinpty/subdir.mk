@@ -24,6 +24,7 @@ $(eval $(call def_mingw_target,libwinpty,-DCOMPILING_WINPTY_DLL))
 
 LIBWINPTY_OBJECTS = \
 	build/libwinpty/libwinpty/AgentLocation.o \
+	build/libwinpty/libwinpty/IoEngine.o \
 	build/libwinpty/libwinpty/winpty.o \
 	build/libwinpty/shared/BackgroundDesktop.o \
 	build/libwinpty/shared/Buffer.o \
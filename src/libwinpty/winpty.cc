@@ -187,6 +187,12 @@ winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs) {
     cfg->timeoutMs = timeoutMs;
 }
 
+WINPTY_API void
+winpty_config_set_cpu_budget(winpty_config_t *cfg, int percent) {
+    ASSERT(cfg != nullptr && percent >= 0 && percent <= 100);
+    cfg->cpuBudget = percent;
+}
+
 
 
 /*****************************************************************************
@@ -656,7 +662,8 @@ winpty_open(const winpty_config_t *cfg,
                 << cfg->flags << L' '
                 << cfg->mouseMode << L' '
                 << cfg->cols << L' '
-                << cfg->rows).str_moved();
+                << cfg->rows << L' '
+                << cfg->cpuBudget).str_moved();
         auto wp = createAgentSession(cfg, desktopName, params,
                                      CREATE_NEW_CONSOLE);
 
@@ -729,6 +736,54 @@ WINPTY_API LPCWSTR winpty_conerr_name(winpty_t *wp) {
 
 
 
+/*****************************************************************************
+ * Shared I/O engine. */
+
+WINPTY_API BOOL
+winpty_io_attach(winpty_t *wp,
+                 winpty_io_callback_t callback /*OPTIONAL*/,
+                 void *context /*OPTIONAL*/,
+                 winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        LockGuard<Mutex> lock(wp->mutex);
+        ASSERT(wp->ioSession == nullptr && "winpty_t is already attached");
+        wp->ioSession.reset(new IoSession(
+            *wp, callback, context,
+            wp->coninPipeName, wp->conoutPipeName, wp->conerrPipeName));
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_io_write(winpty_t *wp, const void *data, DWORD size,
+                winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && wp->ioSession != nullptr);
+        ASSERT(data != nullptr || size == 0);
+        wp->ioSession->write(data, size);
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_io_read(winpty_t *wp, int stream, void *data, DWORD size,
+               DWORD *actual, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && wp->ioSession != nullptr);
+        ASSERT((data != nullptr || size == 0) && actual != nullptr);
+        *actual = 0;
+        *actual = static_cast<DWORD>(wp->ioSession->read(stream, data, size));
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API HANDLE winpty_io_event(winpty_t *wp) {
+    ASSERT(wp != nullptr);
+    return wp->ioSession ? wp->ioSession->readyEvent() : nullptr;
+}
+
+
 /*****************************************************************************
  * winpty agent RPC calls. */
 
@@ -883,6 +938,16 @@ winpty_spawn(winpty_t *wp,
             rpc.success();
             throw LibWinptyException(WINPTY_ERROR_SPAWN_CREATE_PROCESS_FAILED,
                 L"CreateProcess failed");
+        } else if (result == StartProcessResult::ChildStillRunning) {
+            reply.assertEof();
+            rpc.success();
+            throw LibWinptyException(WINPTY_ERROR_SPAWN_CHILD_RUNNING,
+                L"The previous child process is still running");
+        } else if (result == StartProcessResult::AgentShutDown) {
+            reply.assertEof();
+            rpc.success();
+            throw LibWinptyException(WINPTY_ERROR_SPAWN_AGENT_SHUT_DOWN,
+                L"The agent shut down after an auto-shutdown child exited");
         } else if (result == StartProcessResult::ProcessCreated) {
             const HANDLE remoteProcess = handleFromInt64(reply.getInt64());
             const HANDLE remoteThread = handleFromInt64(reply.getInt64());
@@ -914,6 +979,98 @@ winpty_spawn(winpty_t *wp,
 
 
 
+/*****************************************************************************
+ * winpty agent RPC call: history paging. */
+
+WINPTY_API winpty_history_t *
+winpty_read_history(winpty_t *wp, int stream, INT64 first_line,
+                    int line_count, winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        ASSERT(stream == WINPTY_STREAM_CONOUT ||
+               stream == WINPTY_STREAM_CONERR);
+        ASSERT(first_line >= 0 && line_count >= 0);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::ReadHistory);
+        packet.putInt32(stream);
+        packet.putInt64(first_line);
+        packet.putInt32(line_count);
+        writePacket(*wp, packet);
+        auto reply = readPacket(*wp);
+        std::unique_ptr<winpty_history_t> ret(new winpty_history_t);
+        ret->oldestLine = reply.getInt64();
+        ret->endLine = reply.getInt64();
+        ret->firstLine = reply.getInt64();
+        const int count = reply.getInt32();
+        ASSERT(count >= 0 && count <= line_count);
+        ret->text.resize(count);
+        ret->runs.resize(count);
+        for (int i = 0; i < count; ++i) {
+            ret->text[i] = reply.getWString();
+            const int runCount = reply.getInt32();
+            ASSERT(runCount >= 0);
+            ret->runs[i].resize(runCount);
+            for (auto &run : ret->runs[i]) {
+                run.length = reply.getRawValue<uint16_t>();
+                run.attributes = reply.getRawValue<uint16_t>();
+            }
+        }
+        reply.assertEof();
+        rpc.success();
+        return ret.release();
+    } API_CATCH(nullptr)
+}
+
+WINPTY_API INT64 winpty_history_oldest_line(winpty_history_t *history) {
+    ASSERT(history != nullptr);
+    return history->oldestLine;
+}
+
+WINPTY_API INT64 winpty_history_end_line(winpty_history_t *history) {
+    ASSERT(history != nullptr);
+    return history->endLine;
+}
+
+WINPTY_API INT64 winpty_history_first_line(winpty_history_t *history) {
+    ASSERT(history != nullptr);
+    return history->firstLine;
+}
+
+WINPTY_API int winpty_history_line_count(winpty_history_t *history) {
+    ASSERT(history != nullptr);
+    return static_cast<int>(history->text.size());
+}
+
+WINPTY_API LPCWSTR winpty_history_line_text(winpty_history_t *history,
+                                            int index,
+                                            DWORD *length /*OPTIONAL*/) {
+    ASSERT(history != nullptr);
+    ASSERT(index >= 0 && index < static_cast<int>(history->text.size()));
+    const std::wstring &text = history->text[index];
+    if (length != nullptr) {
+        *length = static_cast<DWORD>(text.size());
+    }
+    return text.c_str();
+}
+
+WINPTY_API const winpty_attr_run_t *
+winpty_history_line_runs(winpty_history_t *history, int index,
+                         DWORD *run_count) {
+    ASSERT(history != nullptr && run_count != nullptr);
+    ASSERT(index >= 0 && index < static_cast<int>(history->runs.size()));
+    const auto &runs = history->runs[index];
+    *run_count = static_cast<DWORD>(runs.size());
+    return runs.data();
+}
+
+WINPTY_API void winpty_history_free(winpty_history_t *history) {
+    delete history;
+}
+
+
+
 /*****************************************************************************
  * winpty agent RPC calls: everything else */
 
@@ -935,6 +1092,78 @@ winpty_set_size(winpty_t *wp, int cols, int rows,
     } API_CATCH(FALSE)
 }
 
+WINPTY_API BOOL
+winpty_set_visibility(winpty_t *wp, int visibility,
+                      winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        ASSERT(visibility == WINPTY_VISIBILITY_VISIBLE ||
+               visibility == WINPTY_VISIBILITY_HIDDEN ||
+               visibility == WINPTY_VISIBILITY_MINIMIZED);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::SetVisibility);
+        packet.putInt32(visibility);
+        writePacket(*wp, packet);
+        readPacket(*wp).assertEof();
+        rpc.success();
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_set_viewport(winpty_t *wp, int first_row, int row_count,
+                    winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && first_row >= 0 && row_count >= 0);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::SetViewport);
+        packet.putInt32(first_row);
+        packet.putInt32(row_count);
+        writePacket(*wp, packet);
+        readPacket(*wp).assertEof();
+        rpc.success();
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_set_cpu_budget(winpty_t *wp, int percent,
+                      winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && percent >= 0 && percent <= 100);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::SetCpuBudget);
+        packet.putInt32(percent);
+        writePacket(*wp, packet);
+        readPacket(*wp).assertEof();
+        rpc.success();
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
+WINPTY_API BOOL
+winpty_grant_frame_credits(winpty_t *wp, int credits,
+                           winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::GrantFrameCredits);
+        packet.putInt32(credits);
+        writePacket(*wp, packet);
+        readPacket(*wp).assertEof();
+        rpc.success();
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
 WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
                                 winpty_error_ptr_t *err /*OPTIONAL*/) {
@@ -965,6 +1194,7 @@ winpty_get_console_process_list(winpty_t *wp, int *processList, const int proces
 WINPTY_API void winpty_free(winpty_t *wp) {
     // At least in principle, CloseHandle can fail, so this deletion can
     // fail.  It won't throw an exception, but maybe there's an error that
-    // should be propagated?
+    // should be propagated?  Deleting the winpty_t also detaches it from the
+    // I/O engine, waiting for any of its I/O callbacks to return.
     delete wp;
 }
@@ -27,12 +27,19 @@ struct AgentMsg
         StartProcess,
         SetSize,
         GetConsoleProcessList,
+        SetVisibility,
+        SetViewport,
+        SetCpuBudget,
+        GrantFrameCredits,
+        ReadHistory,
     };
 };
 
 enum class StartProcessResult {
     CreateProcessFailed,
     ProcessCreated,
+    ChildStillRunning,
+    AgentShutDown,
 };
 
 #endif // WINPTY_SHARED_AGENT_MSG_H
@@ -0,0 +1,95 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "StatsPage.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "StringBuilder.h"
+
+StatsPage *initStatsPage(void *memory, uint32_t agentPid) {
+    StatsPage *page = new (memory) StatsPage;
+    page->magic = kStatsPageMagic;
+    page->version = kStatsPageVersion;
+    page->statsSize = sizeof(AgentStats);
+    page->agentPid = agentPid;
+    page->sequence.store(0, std::memory_order_relaxed);
+    page->reserved = 0;
+    page->stats = AgentStats();
+    std::atomic_thread_fence(std::memory_order_release);
+    return page;
+}
+
+void writeStatsPage(StatsPage &page, const AgentStats &stats) {
+    const uint32_t seq = page.sequence.load(std::memory_order_relaxed);
+    page.sequence.store(seq + 1, std::memory_order_relaxed);
+    // Keep the stores to the counters from moving ahead of the odd sequence
+    // number.
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&page.stats, &stats, sizeof(stats));
+    page.sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool readStatsPage(const StatsPage &page, AgentStats &statsOut,
+                   uint32_t *agentPidOut) {
+    if (page.magic != kStatsPageMagic) {
+        return false;
+    }
+    const size_t size = std::min<size_t>(page.statsSize, sizeof(AgentStats));
+    const int kMaxAttempts = 1000;
+    for (int i = 0; i < kMaxAttempts; ++i) {
+        const uint32_t seq1 = page.sequence.load(std::memory_order_acquire);
+        if (seq1 & 1) {
+            continue;
+        }
+        AgentStats copy;
+        memcpy(&copy, &page.stats, size);
+        // Keep the loads of the counters from moving after the second load of
+        // the sequence number.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint32_t seq2 = page.sequence.load(std::memory_order_relaxed);
+        if (seq1 == seq2) {
+            statsOut = copy;
+            if (agentPidOut != nullptr) {
+                *agentPidOut = page.agentPid;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void addLatencySample(uint64_t (&histogram)[kStatsHistogramBuckets],
+                      uint64_t usec) {
+    int bucket = 0;
+    while (bucket < kStatsHistogramBuckets - 1 &&
+            (usec >> (bucket + kStatsHistogramFirstShift)) != 0) {
+        ++bucket;
+    }
+    histogram[bucket]++;
+}
+
+std::wstring statsPageName(uint32_t agentPid) {
+    return (WStringBuilder(64)
+                << L"Local\\winpty-agent-stats-" << agentPid).str_moved();
+}
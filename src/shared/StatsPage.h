@@ -0,0 +1,110 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Each agent publishes its running totals in a small named shared-memory
+// section (see statsPageName), so monitoring tools can sample them without
+// an RPC to the agent.  The agent updates the page under a sequence lock: the
+// sequence number is odd while an update is in progress, and a reader retries
+// if the number was odd, or changed while it copied the counters.
+//
+// The layout is versioned.  Fields are only ever appended to AgentStats, which
+// bumps kStatsPageVersion, so a reader copies the prefix that both sides know
+// about and zero-fills the rest.
+//
+// This header and StatsPage.cc don't use the Windows API, and
+// StatsPageTest.cc is a standalone program that tests them.
+
+#ifndef WINPTY_SHARED_STATS_PAGE_H
+#define WINPTY_SHARED_STATS_PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+const uint32_t kStatsPageMagic = 0x53505457; // "WTPS"
+const uint32_t kStatsPageVersion = 4;
+const size_t kStatsPageSize = 4096;
+
+// Bucket i of a latency histogram counts durations below 2^(i+6)
+// microseconds, i.e. <64us, <128us, ..., and the last bucket counts the rest.
+const int kStatsHistogramBuckets = 16;
+const int kStatsHistogramFirstShift = 6;
+
+// Running totals describing the agent's work, for diagnosing slow or busy
+// sessions.  Counters are cumulative unless marked otherwise.
+struct AgentStats {
+    uint64_t scrapeCount = 0;
+    uint64_t scrapeCpuUsec = 0;     // CPU time spent scraping and encoding
+    uint64_t cpuBudgetHitCount = 0; // scrapes that overdrew the CPU budget
+    uint64_t freezeCount = 0;       // times the console was frozen
+    uint64_t coninBytes = 0;
+    uint64_t conoutBytes = 0;
+    uint64_t conerrBytes = 0;
+    uint64_t conoutQueueBytes = 0;  // current: output not yet sent
+    uint64_t conerrQueueBytes = 0;  // current: output not yet sent
+    uint64_t scrapeLatencyHistogram[kStatsHistogramBuckets] = {};
+    // Version 2
+    uint64_t lineCacheHitCount = 0;     // lines output from the line cache
+    uint64_t lineCacheMissCount = 0;
+    // Version 3
+    uint64_t inputThrottleCount = 0;    // times CONIN reading was paused
+    uint64_t inputThrottledMsec = 0;    // time spent with CONIN paused
+    uint64_t inputThrottled = 0;        // current: 1 while paused
+    // Version 4
+    uint64_t freezeUsec = 0;            // time the console spent frozen
+    uint64_t scrapeLatencySumUsec = 0;  // sum of the scrape latency samples
+    // From writing input into the console to the first scrape that sends
+    // output after it.
+    uint64_t inputLatencyHistogram[kStatsHistogramBuckets] = {};
+    uint64_t inputLatencySumUsec = 0;
+};
+
+struct StatsPage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t statsSize;     // sizeof(AgentStats) in the writer's version
+    uint32_t agentPid;
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    AgentStats stats;
+};
+
+static_assert(sizeof(StatsPage) <= kStatsPageSize,
+              "StatsPage must fit in its shared-memory section");
+
+// Initialize the header of a zeroed, kStatsPageSize-byte section.
+StatsPage *initStatsPage(void *memory, uint32_t agentPid);
+
+// Only one thread may write a page.
+void writeStatsPage(StatsPage &page, const AgentStats &stats);
+
+// Returns false if the page isn't a stats page, or if the writer kept it busy
+// for every attempt.
+bool readStatsPage(const StatsPage &page, AgentStats &statsOut,
+                   uint32_t *agentPidOut=nullptr);
+
+void addLatencySample(uint64_t (&histogram)[kStatsHistogramBuckets],
+                      uint64_t usec);
+
+std::wstring statsPageName(uint32_t agentPid);
+
+#endif // WINPTY_SHARED_STATS_PAGE_H
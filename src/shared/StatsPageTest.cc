@@ -0,0 +1,155 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Standalone test for the stats page.  It doesn't use the Windows API, e.g.:
+//     g++ -std=c++11 -pthread StatsPageTest.cc StatsPage.cc
+
+#include "StatsPage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "../tests/common/TestCheck.h"
+
+namespace {
+
+struct PageMemory {
+    alignas(8) char bytes[kStatsPageSize];
+    PageMemory() { memset(bytes, 0, sizeof(bytes)); }
+};
+
+void testRoundTrip() {
+    PageMemory mem;
+    StatsPage *page = initStatsPage(mem.bytes, 1234);
+    AgentStats stats;
+    stats.scrapeCount = 5;
+    stats.conoutBytes = 1ull << 40;
+    stats.scrapeLatencyHistogram[3] = 7;
+    stats.inputLatencyHistogram[kStatsHistogramBuckets - 1] = 3;
+    stats.inputLatencySumUsec = 1ull << 50;
+    writeStatsPage(*page, stats);
+    AgentStats out;
+    uint32_t pid = 0;
+    CHECK(readStatsPage(*page, out, &pid));
+    CHECK(pid == 1234);
+    CHECK(out.scrapeCount == 5);
+    CHECK(out.conoutBytes == 1ull << 40);
+    CHECK(out.scrapeLatencyHistogram[3] == 7);
+    CHECK(out.inputLatencyHistogram[kStatsHistogramBuckets - 1] == 3);
+    CHECK(out.inputLatencySumUsec == 1ull << 50);
+    CHECK(page->sequence.load() == 2);
+}
+
+void testBadMagic() {
+    PageMemory mem;
+    AgentStats out;
+    CHECK(!readStatsPage(*reinterpret_cast<StatsPage*>(mem.bytes), out));
+}
+
+void testOlderWriter() {
+    // A writer from an older version only knows a prefix of the counters.
+    PageMemory mem;
+    StatsPage *page = initStatsPage(mem.bytes, 1);
+    AgentStats stats;
+    stats.scrapeCount = 9;
+    stats.conerrQueueBytes = 9;
+    writeStatsPage(*page, stats);
+    page->statsSize = offsetof(AgentStats, freezeCount);
+    AgentStats out;
+    CHECK(readStatsPage(*page, out));
+    CHECK(out.scrapeCount == 9);
+    CHECK(out.conerrQueueBytes == 0);
+}
+
+void testBusyWriter() {
+    PageMemory mem;
+    StatsPage *page = initStatsPage(mem.bytes, 1);
+    page->sequence.store(1);
+    AgentStats out;
+    CHECK(!readStatsPage(*page, out));
+}
+
+void testHistogram() {
+    uint64_t hist[kStatsHistogramBuckets] = {};
+    addLatencySample(hist, 0);
+    addLatencySample(hist, 63);
+    addLatencySample(hist, 64);
+    addLatencySample(hist, 127);
+    addLatencySample(hist, 128);
+    addLatencySample(hist, ~0ull);
+    CHECK(hist[0] == 2);
+    CHECK(hist[1] == 2);
+    CHECK(hist[2] == 1);
+    CHECK(hist[kStatsHistogramBuckets - 1] == 1);
+}
+
+// The writer sets every counter to the same value, so a torn read shows up as
+// a mismatch between counters.
+void testConcurrentReads() {
+    PageMemory mem;
+    StatsPage *page = initStatsPage(mem.bytes, 1);
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        AgentStats stats;
+        for (uint64_t i = 1; i <= 200000; ++i) {
+            uint64_t *fields = reinterpret_cast<uint64_t*>(&stats);
+            for (size_t j = 0; j < sizeof(stats) / sizeof(uint64_t); ++j) {
+                fields[j] = i;
+            }
+            writeStatsPage(*page, stats);
+        }
+        done = true;
+    });
+    uint64_t last = 0;
+    int reads = 0;
+    while (!done) {
+        AgentStats out;
+        if (!readStatsPage(*page, out)) {
+            continue;
+        }
+        const uint64_t *fields = reinterpret_cast<const uint64_t*>(&out);
+        for (size_t j = 0; j < sizeof(out) / sizeof(uint64_t); ++j) {
+            CHECK(fields[j] == fields[0]);
+        }
+        CHECK(fields[0] >= last);
+        last = fields[0];
+        ++reads;
+    }
+    writer.join();
+    printf("concurrent: %d consistent reads\n", reads);
+}
+
+} // anonymous namespace
+
+int main() {
+    testRoundTrip();
+    testBadMagic();
+    testOlderWriter();
+    testBusyWriter();
+    testHistogram();
+    testConcurrentReads();
+    CHECK(statsPageName(42) == L"Local\\winpty-agent-stats-42");
+    printf("All tests passed.\n");
+    return 0;
+}
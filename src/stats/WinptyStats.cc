@@ -0,0 +1,352 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// winpty-stats: reads the statistics page of each running winpty agent and
+// prints them in the OpenMetrics text format.  See shared/StatsPage.h.
+
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../shared/OwnedHandle.h"
+#include "../shared/StatsPage.h"
+#include "../shared/StringBuilder.h"
+
+namespace {
+
+struct AgentSample {
+    uint32_t pid;
+    AgentStats stats;
+};
+
+void usage(const char *program, int code) {
+    printf("Usage: %s [--pid PID] [--output FILE [--interval SECONDS]]\n"
+           "\n"
+           "Reads the statistics that running winpty agents publish in shared\n"
+           "memory and prints them in the OpenMetrics text format, labeled with\n"
+           "each agent's process ID.  Only agents running in the current session\n"
+           "are visible.\n"
+           "\n"
+           "  --pid PID            Report only the agent with this process ID\n"
+           "  --output FILE        Replace FILE with the report instead of\n"
+           "                       printing it (e.g. for node_exporter's\n"
+           "                       textfile collector)\n"
+           "  --interval SECONDS   With --output, rewrite FILE periodically\n",
+           program);
+    exit(code);
+}
+
+std::vector<uint32_t> findAgentPids() {
+    std::vector<uint32_t> ret;
+    OwnedHandle snapshot(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
+    if (snapshot.get() == INVALID_HANDLE_VALUE) {
+        snapshot.release();
+        return ret;
+    }
+    PROCESSENTRY32W entry = {};
+    entry.dwSize = sizeof(entry);
+    for (BOOL ok = Process32FirstW(snapshot.get(), &entry); ok;
+            ok = Process32NextW(snapshot.get(), &entry)) {
+        if (_wcsicmp(entry.szExeFile, L"winpty-agent.exe") == 0) {
+            ret.push_back(entry.th32ProcessID);
+        }
+    }
+    return ret;
+}
+
+bool sampleAgent(uint32_t pid, AgentStats &statsOut) {
+    const std::wstring name = statsPageName(pid);
+    OwnedHandle mapping(OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str()));
+    if (mapping.get() == nullptr) {
+        return false;
+    }
+    const void *view = MapViewOfFile(
+        mapping.get(), FILE_MAP_READ, 0, 0, kStatsPageSize);
+    if (view == nullptr) {
+        return false;
+    }
+    uint32_t pagePid = 0;
+    const bool ret = readStatsPage(
+        *static_cast<const StatsPage*>(view), statsOut, &pagePid) &&
+        pagePid == pid;
+    UnmapViewOfFile(view);
+    return ret;
+}
+
+// Format a microsecond count as a decimal number of seconds.
+std::string secondsFromUsec(uint64_t usec) {
+    std::string frac = decOfInt(usec % 1000000).c_str();
+    frac.insert(0, 6 - frac.size(), '0');
+    while (!frac.empty() && frac.back() == '0') {
+        frac.pop_back();
+    }
+    StringBuilder sb(32);
+    sb << (usec / 1000000);
+    if (!frac.empty()) {
+        sb << '.' << frac;
+    }
+    return sb.str_moved();
+}
+
+class MetricsWriter {
+public:
+    void family(const char *name, const char *type, const char *help) {
+        m_out << "# TYPE " << name << ' ' << type << '\n'
+              << "# HELP " << name << ' ' << help << '\n';
+    }
+    void sample(const char *name, uint32_t pid, const char *extraLabels,
+                const std::string &value) {
+        m_out << name << "{pid=\"" << pid << '"' << extraLabels << "} "
+              << value << '\n';
+    }
+    void sample(const char *name, uint32_t pid, const char *extraLabels,
+                uint64_t value) {
+        sample(name, pid, extraLabels, std::string(decOfInt(value).c_str()));
+    }
+    // The buckets are in microseconds, the exported bounds in seconds.
+    void histogram(const char *name, uint32_t pid,
+                   const uint64_t (&buckets)[kStatsHistogramBuckets],
+                   uint64_t sumUsec) {
+        const std::string prefix = name;
+        uint64_t cumulative = 0;
+        for (int i = 0; i < kStatsHistogramBuckets; ++i) {
+            cumulative += buckets[i];
+            std::string le;
+            if (i == kStatsHistogramBuckets - 1) {
+                le = "+Inf";
+            } else {
+                le = secondsFromUsec(
+                    1ull << (i + kStatsHistogramFirstShift));
+            }
+            const std::string labels = ",le=\"" + le + "\"";
+            sample((prefix + "_bucket").c_str(), pid, labels.c_str(),
+                   cumulative);
+        }
+        sample((prefix + "_count").c_str(), pid, "", cumulative);
+        sample((prefix + "_sum").c_str(), pid, "", secondsFromUsec(sumUsec));
+    }
+    std::string finish() {
+        m_out << "# EOF\n";
+        return m_out.str_moved();
+    }
+
+private:
+    StringBuilder m_out { 4096 };
+};
+
+std::string formatMetrics(const std::vector<AgentSample> &samples) {
+    MetricsWriter w;
+
+    w.family("winpty_agent_scrapes", "counter",
+             "Console scrapes performed by the agent.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_scrapes_total", s.pid, "",
+                 s.stats.scrapeCount);
+    }
+
+    w.family("winpty_agent_scrape_cpu_seconds", "counter",
+             "CPU time the agent spent scraping and encoding output.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_scrape_cpu_seconds_total", s.pid, "",
+                 secondsFromUsec(s.stats.scrapeCpuUsec));
+    }
+
+    w.family("winpty_agent_cpu_budget_hits", "counter",
+             "Scrapes that exceeded the agent's CPU budget.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_cpu_budget_hits_total", s.pid, "",
+                 s.stats.cpuBudgetHitCount);
+    }
+
+    w.family("winpty_agent_console_freezes", "counter",
+             "Times the agent froze the console to read it consistently.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_console_freezes_total", s.pid, "",
+                 s.stats.freezeCount);
+    }
+
+    w.family("winpty_agent_console_frozen_seconds", "counter",
+             "Time the console spent frozen.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_console_frozen_seconds_total", s.pid, "",
+                 secondsFromUsec(s.stats.freezeUsec));
+    }
+
+    w.family("winpty_agent_line_cache_lookups", "counter",
+             "Encoded-line cache lookups for repainted lines.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_line_cache_lookups_total", s.pid,
+                 ",result=\"hit\"", s.stats.lineCacheHitCount);
+        w.sample("winpty_agent_line_cache_lookups_total", s.pid,
+                 ",result=\"miss\"", s.stats.lineCacheMissCount);
+    }
+
+    w.family("winpty_agent_input_throttles", "counter",
+             "Times the agent paused reading CONIN because the console "
+             "app wasn't reading its input.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_input_throttles_total", s.pid, "",
+                 s.stats.inputThrottleCount);
+    }
+
+    w.family("winpty_agent_input_throttled_seconds", "counter",
+             "Time spent with CONIN reading paused.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_input_throttled_seconds_total", s.pid, "",
+                 secondsFromUsec(s.stats.inputThrottledMsec * 1000));
+    }
+
+    w.family("winpty_agent_input_throttled", "gauge",
+             "1 while CONIN reading is paused.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_input_throttled", s.pid, "",
+                 s.stats.inputThrottled);
+    }
+
+    w.family("winpty_agent_pipe_bytes", "counter",
+             "Bytes read from CONIN or written to CONOUT/CONERR.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_pipe_bytes_total", s.pid, ",stream=\"conin\"",
+                 s.stats.coninBytes);
+        w.sample("winpty_agent_pipe_bytes_total", s.pid, ",stream=\"conout\"",
+                 s.stats.conoutBytes);
+        w.sample("winpty_agent_pipe_bytes_total", s.pid, ",stream=\"conerr\"",
+                 s.stats.conerrBytes);
+    }
+
+    w.family("winpty_agent_output_queue_bytes", "gauge",
+             "Output the client has not read yet.");
+    for (const auto &s : samples) {
+        w.sample("winpty_agent_output_queue_bytes", s.pid,
+                 ",stream=\"conout\"", s.stats.conoutQueueBytes);
+        w.sample("winpty_agent_output_queue_bytes", s.pid,
+                 ",stream=\"conerr\"", s.stats.conerrQueueBytes);
+    }
+
+    w.family("winpty_agent_scrape_latency_seconds", "histogram",
+             "Wall-clock time of each scrape.");
+    for (const auto &s : samples) {
+        w.histogram("winpty_agent_scrape_latency_seconds", s.pid,
+                    s.stats.scrapeLatencyHistogram,
+                    s.stats.scrapeLatencySumUsec);
+    }
+
+    w.family("winpty_agent_input_latency_seconds", "histogram",
+             "Time from writing input into the console to the first scrape "
+             "that sent output after it.");
+    for (const auto &s : samples) {
+        w.histogram("winpty_agent_input_latency_seconds", s.pid,
+                    s.stats.inputLatencyHistogram,
+                    s.stats.inputLatencySumUsec);
+    }
+
+    return w.finish();
+}
+
+std::string collectMetrics(uint32_t onlyPid) {
+    std::vector<uint32_t> pids;
+    if (onlyPid != 0) {
+        pids.push_back(onlyPid);
+    } else {
+        pids = findAgentPids();
+    }
+    std::vector<AgentSample> samples;
+    for (uint32_t pid : pids) {
+        AgentSample sample;
+        sample.pid = pid;
+        if (sampleAgent(pid, sample.stats)) {
+            samples.push_back(std::move(sample));
+        }
+    }
+    return formatMetrics(samples);
+}
+
+// Write to a temporary file and rename it over the target, so a scraper never
+// sees a partial report.
+bool replaceFile(const std::string &path, const std::string &content) {
+    const std::string tmpPath = path + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+    const bool written =
+        fwrite(content.data(), 1, content.size(), fp) == content.size();
+    if (fclose(fp) != 0 || !written) {
+        DeleteFileA(tmpPath.c_str());
+        return false;
+    }
+    return MoveFileExA(tmpPath.c_str(), path.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    uint32_t onlyPid = 0;
+    std::string outputPath;
+    int intervalSec = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage(argv[0], 0);
+        } else if (arg == "--pid" && i + 1 < argc) {
+            onlyPid = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--interval" && i + 1 < argc) {
+            intervalSec = atoi(argv[++i]);
+            if (intervalSec <= 0) {
+                usage(argv[0], 1);
+            }
+        } else {
+            usage(argv[0], 1);
+        }
+    }
+    if (intervalSec != 0 && outputPath.empty()) {
+        usage(argv[0], 1);
+    }
+
+    if (outputPath.empty()) {
+        const std::string report = collectMetrics(onlyPid);
+        fwrite(report.data(), 1, report.size(), stdout);
+        return 0;
+    }
+
+    while (true) {
+        if (!replaceFile(outputPath, collectMetrics(onlyPid))) {
+            fprintf(stderr, "error: could not write %s\n",
+                outputPath.c_str());
+            return 1;
+        }
+        if (intervalSec == 0) {
+            return 0;
+        }
+        Sleep(intervalSec * 1000);
+    }
+}
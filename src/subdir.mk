@@ -1,5 +1,6 @@
 include src/agent/subdir.mk
 include src/debugserver/subdir.mk
 include src/libwinpty/subdir.mk
+include src/stats/subdir.mk
 include src/tests/subdir.mk
 include src/unix-adapter/subdir.mk
@@ -0,0 +1,314 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// A minimal stand-in for <windows.h>, with just enough of the console API for
+// the input-fuzz harness and the agent's standalone tests to compile on Linux.
+// The constants match the Windows SDK.  The functions are only declared; a
+// program that calls them defines them itself (see InputFuzzStubs.cc).
+
+#ifndef TESTS_COMMON_WINDOWS_H
+#define TESTS_COMMON_WINDOWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int16_t SHORT;
+typedef int32_t LONG;
+typedef unsigned int UINT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef const WCHAR *LPCWSTR;
+typedef void *HANDLE;
+typedef struct HWND__ *HWND;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+
+typedef struct _COORD {
+    SHORT X;
+    SHORT Y;
+} COORD;
+
+typedef struct _SMALL_RECT {
+    SHORT Left;
+    SHORT Top;
+    SHORT Right;
+    SHORT Bottom;
+} SMALL_RECT;
+
+typedef struct _OVERLAPPED {
+    uintptr_t Internal;
+    uintptr_t InternalHigh;
+    DWORD Offset;
+    DWORD OffsetHigh;
+    HANDLE hEvent;
+} OVERLAPPED;
+
+typedef union _LARGE_INTEGER {
+    int64_t QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _CHAR_INFO {
+    union {
+        WCHAR UnicodeChar;
+        CHAR AsciiChar;
+    } Char;
+    WORD Attributes;
+} CHAR_INFO;
+
+typedef struct _KEY_EVENT_RECORD {
+    BOOL bKeyDown;
+    WORD wRepeatCount;
+    WORD wVirtualKeyCode;
+    WORD wVirtualScanCode;
+    union {
+        WCHAR UnicodeChar;
+        CHAR AsciiChar;
+    } uChar;
+    DWORD dwControlKeyState;
+} KEY_EVENT_RECORD;
+
+typedef struct _MOUSE_EVENT_RECORD {
+    COORD dwMousePosition;
+    DWORD dwButtonState;
+    DWORD dwControlKeyState;
+    DWORD dwEventFlags;
+} MOUSE_EVENT_RECORD;
+
+typedef struct _INPUT_RECORD {
+    WORD EventType;
+    union {
+        KEY_EVENT_RECORD KeyEvent;
+        MOUSE_EVENT_RECORD MouseEvent;
+    } Event;
+} INPUT_RECORD;
+
+#define FOREGROUND_BLUE                 0x0001
+#define FOREGROUND_GREEN                0x0002
+#define FOREGROUND_RED                  0x0004
+#define FOREGROUND_INTENSITY            0x0008
+#define BACKGROUND_BLUE                 0x0010
+#define BACKGROUND_GREEN                0x0020
+#define BACKGROUND_RED                  0x0040
+#define BACKGROUND_INTENSITY            0x0080
+
+#define KEY_EVENT                       0x0001
+#define MOUSE_EVENT                     0x0002
+
+#define ENABLE_PROCESSED_INPUT          0x0001
+#define ENABLE_LINE_INPUT               0x0002
+#define ENABLE_ECHO_INPUT               0x0004
+#define ENABLE_WINDOW_INPUT             0x0008
+#define ENABLE_MOUSE_INPUT              0x0010
+#define ENABLE_INSERT_MODE              0x0020
+#define ENABLE_QUICK_EDIT_MODE          0x0040
+#define ENABLE_EXTENDED_FLAGS           0x0080
+#define ENABLE_VIRTUAL_TERMINAL_INPUT   0x0200
+
+#define RIGHT_ALT_PRESSED               0x0001
+#define LEFT_ALT_PRESSED                0x0002
+#define RIGHT_CTRL_PRESSED              0x0004
+#define LEFT_CTRL_PRESSED               0x0008
+#define SHIFT_PRESSED                   0x0010
+#define NUMLOCK_ON                      0x0020
+#define SCROLLLOCK_ON                   0x0040
+#define CAPSLOCK_ON                     0x0080
+#define ENHANCED_KEY                    0x0100
+
+#define FROM_LEFT_1ST_BUTTON_PRESSED    0x0001
+#define RIGHTMOST_BUTTON_PRESSED        0x0002
+#define FROM_LEFT_2ND_BUTTON_PRESSED    0x0004
+#define FROM_LEFT_3RD_BUTTON_PRESSED    0x0008
+#define FROM_LEFT_4TH_BUTTON_PRESSED    0x0010
+
+#define MOUSE_MOVED                     0x0001
+#define DOUBLE_CLICK                    0x0002
+#define MOUSE_WHEELED                   0x0004
+#define MOUSE_HWHEELED                  0x0008
+
+#define EVENT_CONSOLE_CARET             0x4001
+#define EVENT_CONSOLE_UPDATE_REGION     0x4002
+#define EVENT_CONSOLE_UPDATE_SIMPLE     0x4003
+#define EVENT_CONSOLE_UPDATE_SCROLL     0x4004
+#define EVENT_CONSOLE_LAYOUT            0x4005
+
+#define CTRL_C_EVENT                    0
+#define WM_KEYDOWN                      0x0100
+#define WM_KEYUP                        0x0101
+#define MAPVK_VK_TO_VSC                 0
+
+#define VK_RBUTTON              0x02
+#define VK_CANCEL               0x03
+#define VK_MBUTTON              0x04
+#define VK_XBUTTON1             0x05
+#define VK_XBUTTON2             0x06
+#define VK_BACK                 0x08
+#define VK_TAB                  0x09
+#define VK_CLEAR                0x0C
+#define VK_RETURN               0x0D
+#define VK_SHIFT                0x10
+#define VK_CONTROL              0x11
+#define VK_MENU                 0x12
+#define VK_PAUSE                0x13
+#define VK_CAPITAL              0x14
+#define VK_HANGUL               0x15
+#define VK_JUNJA                0x17
+#define VK_FINAL                0x18
+#define VK_KANJI                0x19
+#define VK_ESCAPE               0x1B
+#define VK_CONVERT              0x1C
+#define VK_NONCONVERT           0x1D
+#define VK_ACCEPT               0x1E
+#define VK_MODECHANGE           0x1F
+#define VK_SPACE                0x20
+#define VK_PRIOR                0x21
+#define VK_NEXT                 0x22
+#define VK_END                  0x23
+#define VK_HOME                 0x24
+#define VK_LEFT                 0x25
+#define VK_UP                   0x26
+#define VK_RIGHT                0x27
+#define VK_DOWN                 0x28
+#define VK_SELECT               0x29
+#define VK_PRINT                0x2A
+#define VK_EXECUTE              0x2B
+#define VK_SNAPSHOT             0x2C
+#define VK_INSERT               0x2D
+#define VK_DELETE               0x2E
+#define VK_HELP                 0x2F
+#define VK_LWIN                 0x5B
+#define VK_RWIN                 0x5C
+#define VK_APPS                 0x5D
+#define VK_SLEEP                0x5F
+#define VK_NUMPAD0              0x60
+#define VK_NUMPAD1              0x61
+#define VK_NUMPAD2              0x62
+#define VK_NUMPAD3              0x63
+#define VK_NUMPAD4              0x64
+#define VK_NUMPAD5              0x65
+#define VK_NUMPAD6              0x66
+#define VK_NUMPAD7              0x67
+#define VK_NUMPAD8              0x68
+#define VK_NUMPAD9              0x69
+#define VK_MULTIPLY             0x6A
+#define VK_ADD                  0x6B
+#define VK_SEPARATOR            0x6C
+#define VK_SUBTRACT             0x6D
+#define VK_DECIMAL              0x6E
+#define VK_DIVIDE               0x6F
+#define VK_F1                   0x70
+#define VK_F2                   0x71
+#define VK_F3                   0x72
+#define VK_F4                   0x73
+#define VK_F5                   0x74
+#define VK_F6                   0x75
+#define VK_F7                   0x76
+#define VK_F8                   0x77
+#define VK_F9                   0x78
+#define VK_F10                  0x79
+#define VK_F11                  0x7A
+#define VK_F12                  0x7B
+#define VK_F13                  0x7C
+#define VK_F14                  0x7D
+#define VK_F15                  0x7E
+#define VK_F16                  0x7F
+#define VK_F17                  0x80
+#define VK_F18                  0x81
+#define VK_F19                  0x82
+#define VK_F20                  0x83
+#define VK_F21                  0x84
+#define VK_F22                  0x85
+#define VK_F23                  0x86
+#define VK_F24                  0x87
+#define VK_NUMLOCK              0x90
+#define VK_SCROLL               0x91
+#define VK_LSHIFT               0xA0
+#define VK_RSHIFT               0xA1
+#define VK_LCONTROL             0xA2
+#define VK_RCONTROL             0xA3
+#define VK_LMENU                0xA4
+#define VK_RMENU                0xA5
+#define VK_BROWSER_BACK         0xA6
+#define VK_BROWSER_FORWARD      0xA7
+#define VK_BROWSER_REFRESH      0xA8
+#define VK_BROWSER_STOP         0xA9
+#define VK_BROWSER_SEARCH       0xAA
+#define VK_BROWSER_FAVORITES    0xAB
+#define VK_BROWSER_HOME         0xAC
+#define VK_VOLUME_MUTE          0xAD
+#define VK_VOLUME_DOWN          0xAE
+#define VK_VOLUME_UP            0xAF
+#define VK_MEDIA_NEXT_TRACK     0xB0
+#define VK_MEDIA_PREV_TRACK     0xB1
+#define VK_MEDIA_STOP           0xB2
+#define VK_MEDIA_PLAY_PAUSE     0xB3
+#define VK_LAUNCH_MAIL          0xB4
+#define VK_LAUNCH_MEDIA_SELECT  0xB5
+#define VK_LAUNCH_APP1          0xB6
+#define VK_LAUNCH_APP2          0xB7
+#define VK_OEM_1                0xBA
+#define VK_OEM_PLUS             0xBB
+#define VK_OEM_COMMA            0xBC
+#define VK_OEM_MINUS            0xBD
+#define VK_OEM_PERIOD           0xBE
+#define VK_OEM_2                0xBF
+#define VK_OEM_3                0xC0
+#define VK_OEM_4                0xDB
+#define VK_OEM_5                0xDC
+#define VK_OEM_6                0xDD
+#define VK_OEM_7                0xDE
+#define VK_OEM_8                0xDF
+#define VK_OEM_102              0xE2
+#define VK_PROCESSKEY           0xE5
+#define VK_PACKET               0xE7
+#define VK_ATTN                 0xF6
+#define VK_CRSEL                0xF7
+#define VK_EXSEL                0xF8
+#define VK_EREOF                0xF9
+#define VK_PLAY                 0xFA
+#define VK_ZOOM                 0xFB
+#define VK_NONAME               0xFC
+#define VK_PA1                  0xFD
+#define VK_OEM_CLEAR            0xFE
+
+BOOL GetConsoleMode(HANDLE handle, DWORD *mode);
+BOOL SetConsoleMode(HANDLE handle, DWORD mode);
+BOOL WriteConsoleInputW(HANDLE handle, const INPUT_RECORD *records,
+                        DWORD count, DWORD *written);
+BOOL FlushConsoleInputBuffer(HANDLE handle);
+BOOL GetNumberOfConsoleInputEvents(HANDLE handle, DWORD *count);
+BOOL GenerateConsoleCtrlEvent(DWORD ctrlEvent, DWORD processGroupId);
+DWORD GetTickCount();
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency);
+UINT GetDoubleClickTime();
+SHORT VkKeyScan(WCHAR ch);
+UINT MapVirtualKey(UINT code, UINT mapType);
+LRESULT SendMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+#endif // TESTS_COMMON_WINDOWS_H
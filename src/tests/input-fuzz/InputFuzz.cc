@@ -0,0 +1,210 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Worst-case complexity check for the agent's input parser.  It feeds
+// ConsoleInput (and, through it, InputMap) families of adversarial byte
+// streams -- long ESC runs, incomplete mouse sequences, huge numbers, random
+// escape-heavy bytes -- at two sizes, and fails if a family's cost per byte
+// grows much faster than the input.  Every family is also delivered one byte
+// per write, which is the worst case for rescanning the pending-byte queue.
+//
+// It runs on Linux, using the shared windows.h in src/tests/common and this
+// directory's stubs.  From the top of the tree, compile it with one command:
+//
+//     g++ -std=c++11 -O2 -DWINPTY_AGENT_ASSERT -Isrc/tests/common
+//         -o input-fuzz src/tests/input-fuzz/*.cc
+//         src/agent/ConsoleInput.cc src/agent/ConsoleInputReencoding.cc
+//         src/agent/DefaultInputMap.cc src/agent/InputMap.cc
+//         src/agent/MouseMotionDetector.cc
+//     ./input-fuzz
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../../agent/ConsoleInput.h"
+#include "../../agent/DsrSender.h"
+#include "../../agent/Win32Console.h"
+#include "../../include/winpty_constants.h"
+
+#include "InputFuzzStubs.h"
+
+namespace {
+
+const size_t kSmallSize = 4 * 1024;
+const size_t kLargeSize = 64 * 1024;
+
+// Allowed growth in the cost per byte between the two sizes.  A quadratic
+// parser shows a ratio near kLargeSize / kSmallSize (16).  Linear families
+// still reach 3-5 in whole-buffer writes, because the large input's record
+// vector no longer fits in the cache.
+const double kMaxCostRatio = 6.0;
+
+class NullDsrSender : public DsrSender {
+public:
+    void sendDsr() override {}
+    void setSyncOutputSupported(bool supported) override {}
+};
+
+struct Family {
+    const char *name;
+    std::function<std::string(size_t)> generate;
+};
+
+std::string repeatTo(const std::string &unit, size_t size) {
+    std::string ret;
+    ret.reserve(size + unit.size());
+    while (ret.size() < size) {
+        ret += unit;
+    }
+    return ret;
+}
+
+// A fixed-seed LCG, so runs are reproducible.
+std::string randomFrom(const std::string &alphabet, size_t size,
+                       uint32_t seed) {
+    std::string ret(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        ret[i] = alphabet[(seed >> 16) % alphabet.size()];
+    }
+    return ret;
+}
+
+std::vector<Family> families() {
+    const auto repeat = [](std::string unit) {
+        return [unit](size_t n) { return repeatTo(unit, n); };
+    };
+    return {
+        { "ascii",              repeat("hello world ") },
+        { "utf8",               repeat("h\xC3\xA9llo \xE2\x9C\x93 ") },
+        { "utf8-truncated",     repeat("\xE2\x82") },
+        { "ctrl-chars",         repeat("\x01\x02\x03\x7F\r\t") },
+        { "esc-run",            repeat("\x1B") },
+        { "csi-prefix",         repeat("\x1B[") },
+        { "ss3-prefix",         repeat("\x1BO") },
+        { "csi-modifiers",      repeat("\x1B[1;5A\x1B[3;2~") },
+        { "csi-huge-int",       [](size_t n) {
+            return "\x1B[" + std::string(n, '9') + "~";
+        } },
+        { "csi-many-params",    [](size_t n) {
+            return "\x1B[" + repeatTo("1;", n) + "R";
+        } },
+        { "dsr-reply",          repeat("\x1B[12;34R") },
+        { "decrpm-reply",       repeat("\x1B[?2026;2$y") },
+        { "mouse-x10",          repeat("\x1B[M !!") },
+        { "mouse-x10-partial",  repeat("\x1B[M") },
+        { "mouse-sgr",          repeat("\x1B[<0;12;34M") },
+        { "mouse-sgr-partial",  repeat("\x1B[<0;12;") },
+        { "mouse-sgr-huge-int", [](size_t n) {
+            return "\x1B[<" + std::string(n, '9') + ";1;1M";
+        } },
+        { "mouse-urxvt",        repeat("\x1B[32;12;34M") },
+        { "random-escape",      [](size_t n) {
+            return randomFrom("\x1B[<;?$yMOR~0123456789ab\x7F\xC3\xA9",
+                              n, 1);
+        } },
+        { "random-bytes",       [](size_t n) {
+            std::string alphabet;
+            for (int i = 0; i < 256; ++i) {
+                alphabet.push_back(static_cast<char>(i));
+            }
+            return randomFrom(alphabet, n, 2);
+        } },
+    };
+}
+
+struct Config {
+    const char *name;
+    DWORD consoleMode;
+};
+
+const Config kConfigs[] = {
+    { "keys",  ENABLE_EXTENDED_FLAGS | ENABLE_PROCESSED_INPUT },
+    { "mouse", ENABLE_EXTENDED_FLAGS | ENABLE_MOUSE_INPUT },
+    { "vt",    ENABLE_EXTENDED_FLAGS | ENABLE_VIRTUAL_TERMINAL_INPUT },
+};
+
+// Returns nanoseconds per input byte, the best of a few runs.
+double measure(const Config &config, const std::string &input,
+               size_t chunkSize) {
+    double best = 1e300;
+    for (int rep = 0; rep < 5; ++rep) {
+        g_consoleMode = config.consoleMode;
+        Win32Console console;
+        NullDsrSender dsrSender;
+        ConsoleInput consoleInput(nullptr, WINPTY_MOUSE_MODE_AUTO,
+                                  dsrSender, console);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < input.size(); i += chunkSize) {
+            consoleInput.writeInput(input.substr(i, chunkSize));
+        }
+        // Let the incomplete-escape timeout expire.
+        g_tickCount += 10000;
+        consoleInput.flushIncompleteEscapeCode();
+        const auto end = std::chrono::steady_clock::now();
+        const double ns =
+            std::chrono::duration<double, std::nano>(end - start).count();
+        best = std::min(best, ns / input.size());
+    }
+    return best;
+}
+
+} // anonymous namespace
+
+int main() {
+    int failures = 0;
+    printf("%-20s %-6s %-6s %10s %10s %7s\n",
+        "family", "mode", "write", "ns/B small", "ns/B large", "ratio");
+    for (const auto &family : families()) {
+        const std::string small = family.generate(kSmallSize);
+        const std::string large = family.generate(kLargeSize);
+        for (const auto &config : kConfigs) {
+            for (size_t chunkSize : { kLargeSize * 2, size_t(1) }) {
+                const double smallCost = measure(config, small, chunkSize);
+                const double largeCost = measure(config, large, chunkSize);
+                const double ratio = largeCost / smallCost;
+                const bool failed = ratio > kMaxCostRatio;
+                printf("%-20s %-6s %-6s %10.1f %10.1f %7.2f%s\n",
+                    family.name, config.name,
+                    chunkSize == 1 ? "byte" : "whole",
+                    smallCost, largeCost, ratio,
+                    failed ? "  SUPERLINEAR" : "");
+                if (failed) {
+                    ++failures;
+                }
+            }
+        }
+    }
+    if (failures > 0) {
+        printf("FAILED: %d superlinear cases\n", failures);
+        return 1;
+    }
+    printf("All input families scale linearly.\n");
+    return 0;
+}
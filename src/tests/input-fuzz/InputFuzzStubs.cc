@@ -0,0 +1,111 @@
+// Copyright (c) 2017 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Definitions for the declarations in this directory's windows.h, plus stub
+// versions of the agent modules that ConsoleInput uses but the harness doesn't
+// compile.  Input records written to the console are counted and discarded.
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "../../agent/DebugShowInput.h"
+#include "../../agent/Win32Console.h"
+#include "../../shared/DebugClient.h"
+#include "../../shared/WinptyAssert.h"
+
+#include "InputFuzzStubs.h"
+
+DWORD g_consoleMode = 0;
+DWORD g_tickCount = 0;
+uint64_t g_recordCount = 0;
+
+BOOL GetConsoleMode(HANDLE handle, DWORD *mode) {
+    *mode = g_consoleMode;
+    return TRUE;
+}
+
+BOOL SetConsoleMode(HANDLE handle, DWORD mode) {
+    g_consoleMode = mode;
+    return TRUE;
+}
+
+BOOL WriteConsoleInputW(HANDLE handle, const INPUT_RECORD *records,
+                        DWORD count, DWORD *written) {
+    g_recordCount += count;
+    *written = count;
+    return TRUE;
+}
+
+BOOL FlushConsoleInputBuffer(HANDLE handle) { return TRUE; }
+BOOL GetNumberOfConsoleInputEvents(HANDLE handle, DWORD *count) {
+    *count = 0;
+    return TRUE;
+}
+BOOL GenerateConsoleCtrlEvent(DWORD ctrlEvent, DWORD processGroupId) {
+    return TRUE;
+}
+DWORD GetTickCount() { return g_tickCount; }
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count) {
+    count->QuadPart = static_cast<int64_t>(g_tickCount) * 1000;
+    return TRUE;
+}
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency) {
+    frequency->QuadPart = 1000000;
+    return TRUE;
+}
+UINT GetDoubleClickTime() { return 500; }
+UINT MapVirtualKey(UINT code, UINT mapType) { return 0; }
+LRESULT SendMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    return 0;
+}
+
+// A rough US keyboard layout: letters, digits, and space map to their own
+// virtual keys, and other characters need no modifiers.
+SHORT VkKeyScan(WCHAR ch) {
+    if (ch >= 'a' && ch <= 'z') {
+        return ch - 'a' + 'A';
+    } else if (ch >= 'A' && ch <= 'Z') {
+        return 0x100 | ch;
+    } else if (ch >= 0x20 && ch < 0x7F) {
+        return ch;
+    } else {
+        return -1;
+    }
+}
+
+Win32Console::Win32Console() {}
+
+bool isTracingEnabled() { return false; }
+bool hasDebugFlag(const char *flag) { return false; }
+void trace(const char *format, ...) {}
+
+void agentShutdown() {}
+void agentAssertFail(const char *file, int line, const char *cond) {
+    fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, cond);
+    abort();
+}
+
+std::string controlKeyStatePrefix(DWORD controlKeyState) { return ""; }
+std::string mouseEventToString(const MOUSE_EVENT_RECORD &mer) { return ""; }
+void debugShowInput(bool enableMouse, bool escapeInput) {}
@@ -52,6 +52,8 @@
                 'agent/Agent.cc',
                 'agent/AgentCreateDesktop.h',
                 'agent/AgentCreateDesktop.cc',
+                'agent/ConsoleChangeSource.cc',
+                'agent/ConsoleChangeSource.h',
                 'agent/ConsoleFont.cc',
                 'agent/ConsoleFont.h',
                 'agent/ConsoleInput.cc',
@@ -66,14 +68,24 @@
                 'agent/DefaultInputMap.h',
                 'agent/DefaultInputMap.cc',
                 'agent/DsrSender.h',
+                'agent/EncodedLineCache.h',
+                'agent/EncodedLineCache.cc',
                 'agent/EventLoop.h',
                 'agent/EventLoop.cc',
+                'agent/HistoryStore.h',
+                'agent/HistoryStore.cc',
                 'agent/InputMap.h',
                 'agent/InputMap.cc',
                 'agent/LargeConsoleRead.h',
                 'agent/LargeConsoleRead.cc',
+                'agent/MouseMotionDetector.h',
+                'agent/MouseMotionDetector.cc',
                 'agent/NamedPipe.h',
                 'agent/NamedPipe.cc',
+                'agent/ResizePlanner.h',
+                'agent/ResizePlanner.cc',
+                'agent/ScrapeScheduler.h',
+                'agent/ScrapeScheduler.cc',
                 'agent/Scraper.h',
                 'agent/Scraper.cc',
                 'agent/SimplePool.h',
@@ -85,6 +97,8 @@
                 'agent/Win32Console.h',
                 'agent/Win32ConsoleBuffer.cc',
                 'agent/Win32ConsoleBuffer.h',
+                'agent/WinEventChangeSource.cc',
+                'agent/WinEventChangeSource.h',
                 'agent/main.cc',
                 'shared/AgentMsg.h',
                 'shared/BackgroundDesktop.h',
@@ -98,6 +112,8 @@
                 'shared/OsModule.h',
                 'shared/OwnedHandle.h',
                 'shared/OwnedHandle.cc',
+                'shared/StatsPage.h',
+                'shared/StatsPage.cc',
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
@@ -139,6 +155,8 @@
                 'include/winpty.h',
                 'libwinpty/AgentLocation.cc',
                 'libwinpty/AgentLocation.h',
+                'libwinpty/IoEngine.cc',
+                'libwinpty/IoEngine.h',
                 'libwinpty/winpty.cc',
                 'shared/AgentMsg.h',
                 'shared/BackgroundDesktop.h',
@@ -201,6 +219,42 @@
             'libraries' : [
                 '-ladvapi32',
             ],
+        },
+        {
+            'target_name' : 'winpty-stats',
+            'type' : 'executable',
+            'msvs_settings': {
+                # Specify this setting here to override a setting from somewhere
+                # else, such as node's common.gypi.
+                'VCCLCompilerTool': {
+                    'ExceptionHandling': '1', # /EHsc
+                },
+            },
+            'sources' : [
+                'stats/WinptyStats.cc',
+                'shared/DebugClient.h',
+                'shared/DebugClient.cc',
+                'shared/OwnedHandle.h',
+                'shared/OwnedHandle.cc',
+                'shared/OsModule.h',
+                'shared/StatsPage.h',
+                'shared/StatsPage.cc',
+                'shared/StringBuilder.h',
+                'shared/StringUtil.cc',
+                'shared/StringUtil.h',
+                'shared/WindowsSecurity.h',
+                'shared/WindowsSecurity.cc',
+                'shared/WindowsVersion.h',
+                'shared/WindowsVersion.cc',
+                'shared/WinptyAssert.h',
+                'shared/WinptyAssert.cc',
+                'shared/WinptyException.h',
+                'shared/WinptyException.cc',
+                'shared/winpty_snprintf.h',
+            ],
+            'libraries' : [
+                '-ladvapi32',
+            ],
         }
     ],
 }